@@ -0,0 +1,5521 @@
+/********************************************************************************
+*** libsud: the engine of the sudoku solver, written in K&R C.
+*** Copyright 2021 Adam Jaworski.
+*** MIT License
+***
+*** Everything that solves puzzles lives here, and nothing that reads or writes
+*** files: there is no global state, no stdio and no exit(), so the engine can
+*** be linked into another program and called from any number of threads, each
+*** with a solver of its own. The interface for other programs is in sud.h, and
+*** everything else is static, so none of it can clash with the names of the
+*** program the library goes into. The sud program includes this file whole, so
+*** that it still builds as one unit, and defines SUD_PROGRAM first for the parts
+*** only it uses: variant layouts, packed files, writing a store, and making and
+*** hunting puzzles. The library builds with:
+***   cc -O2 -fPIC -pthread -c libsud.c && ar rcs libsud.a libsud.o
+***   cc -shared -pthread -o libsud.so libsud.o
+********************************************************************************/
+
+
+/* Standard library header files needed on all but the most ancient systems. */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/eventfd.h>
+#include "sud.h"
+
+/* The region size sets the size of the whole grid, so a build with
+** cc -DR_ROWS=10 -DR_COLS=10 solves 100x100 grids and -DR_ROWS=12 -DR_COLS=12
+** solves 144x144 grids. The default is the classic 9x9 game. */
+#ifndef R_ROWS
+#define R_ROWS 3               /* region rows */
+#endif
+#ifndef R_COLS
+#define R_COLS 3               /* region columns */
+#endif
+#define MAX_VAL (R_ROWS*R_COLS)
+#define ROWS MAX_VAL
+#define COLS MAX_VAL
+#define SOLVED 1               /* bit 0 in a cell is a flag to indicate if a it is solved */
+#define MAX_SUM (MAX_VAL*(MAX_VAL+1)/2)   /* sum of all the values in a unit */
+#define MAX_CAGE_VAL 16        /* killer cages need a table of every set of values, */
+#define NCOMBOS (1 << (MAX_VAL <= MAX_CAGE_VAL ? MAX_VAL : 0))   /* which is this big */
+#define MAX_GRIDS 64           /* most overlapping grids in one puzzle (samurai has 5) */
+
+/********************************************************************************
+*** Possible values in a cell are indicated as a bit field within an integer value type.
+*** so the cell value 0b1111111110 indicates
+***                     987654321U the solutions 1-9 are available and the cell is unsolved(U).
+*** whereas the value 0b1000010000 indicates
+***                     9----4---U the solutions 9 and 4 are possible for this unsolved cell,
+*** and the value     0b0000001001 indicates
+***                     ------3--S that the cell is solved(S) with the solution 3. 
+***
+*** Up to 31 possible values fit in a single int. Beyond that the bit field is
+*** spread over an array of 64 bit words, with just enough words to hold bits
+*** 0..MAX_VAL, so a 144x144 cell takes 3 words and a 9x9 cell is still one int.
+********************************************************************************/
+#if MAX_VAL < 32
+#define CELL_WORD unsigned int
+#define WORD_BITS 32
+#define POPCOUNT(w) __builtin_popcount(w)
+#define FFS(w) __builtin_ctz(w)
+#else
+#define CELL_WORD unsigned long long
+#define WORD_BITS 64
+#define POPCOUNT(w) __builtin_popcountll(w)
+#define FFS(w) __builtin_ctzll(w)
+#endif
+#define CELL_WORDS ((MAX_VAL + WORD_BITS) / WORD_BITS)
+#define WORD(k) ((k) / WORD_BITS)                      /* word holding value k */
+#define BIT(k) ((CELL_WORD)1 << ((k) % WORD_BITS))     /* bit for value k in that word */
+
+/* compilers without the gcc/clang bit counting builtins get portable loops */
+/* one line puzzles are parsed 32 or 16 characters at a time where we can */
+#if (MAX_VAL <= 9) && defined(__AVX2__)
+#include <immintrin.h>
+#define PARSE_BLOCK 32
+#elif (MAX_VAL <= 9) && defined(__SSE2__)
+#include <emmintrin.h>
+#define PARSE_BLOCK 16
+#endif
+
+#ifndef __GNUC__
+#undef POPCOUNT
+#undef FFS
+#define POPCOUNT(w) word_popcount(w)
+#define FFS(w) word_ffs(w)
+
+static int
+word_popcount(w)
+  CELL_WORD w;
+{
+  int n;
+  for (n=0; w; n++) w &= w - 1;
+  return n;
+}
+
+static int
+word_ffs(w)
+  CELL_WORD w;
+{
+  int n;
+  for (n=0; !(w & 1); n++) w >>= 1;
+  return n;
+}
+#endif
+
+
+/* a single cell of the grid, holding the bit field described above */
+struct cell { CELL_WORD w[CELL_WORDS]; };
+
+/********************************************************************************
+*** The constraint graph of a puzzle. Every constraint is a unit: a group of cells
+*** that must all hold different values (a row, column, region, diagonal, window
+*** and so on). Two cells are peers if they share a unit. Once all the units are
+*** in, the graph is compiled into one flat array of peers per cell, so that
+*** reduce() is the same tight loop for every variant.
+*** Cells are numbered row by row, so cell i is at row i/cols, column i%cols.
+*** The layout can be bigger than a single grid, with several grids overlapping
+*** in it (samurai). Places in the layout that aren't in any unit are holes.
+********************************************************************************/
+struct graph {
+  int rows, cols;      /* layout of the cells, used for reading and printing */
+  int ncells;          /* number of cells (rows*cols) */
+  int nholes;          /* number of holes in the layout, */
+  char *hole;          /* and which cells they are */
+  int *line_cell;      /* the cell for each place in a one line puzzle (skipping holes) */
+  int boxed;           /* set if the regions are the classic R_ROWS x R_COLS boxes */
+  int nunits;          /* number of units */
+  int *unit_start;     /* unit u is unit_cells[unit_start[u]] .. unit_cells[unit_start[u+1]-1] */
+  int *unit_cells;
+  int *peer_start;     /* peers of cell i are peers[peer_start[i]] .. peers[peer_start[i+1]-1] */
+  int *peers;
+  int units_room;      /* allocated sizes of unit_start and unit_cells */
+  int cells_room;
+  int ncages;          /* number of killer cages */
+  int *cage_sum;       /* the values in cage c add up to cage_sum[c] */
+  int *cage_start;     /* cage c is cage_cells[cage_start[c]] .. cage_cells[cage_start[c+1]-1] */
+  int *cage_cells;
+  int *combo_start;    /* sets of n values adding up to s are combos[combo_start[n*(MAX_SUM+1)+s]] .. */
+  CELL_WORD *combos;   /* .. combos[combo_start[n*(MAX_SUM+1)+s+1]-1], as cell bit fields */
+};
+
+/* the data structure that holds the 'state' of a solved or unsolved sudoku game,
+** allocated with room for as many cells as its graph has */
+struct grid { struct graph *gr; int solved_counter; struct cell cells[1]; };
+
+#define GRID_SIZE(gr) (sizeof(struct grid) + ((gr)->ncells - 1) * sizeof(struct cell))
+
+
+/********************************************************************************
+*** Open a cell, with all values 1..MAX_VAL possible and the solved flag clear.
+********************************************************************************/
+static void
+open_cell(c)
+  struct cell *c;
+{
+  int k;
+  for (k=0; k<CELL_WORDS; k++) {
+    c->w[k] = 0;
+  }
+  for (k=1; k<=MAX_VAL; k++) {
+    c->w[WORD(k)] |= BIT(k);
+  }
+}
+
+
+/********************************************************************************
+*** Initialise a solution grid with all values available in all cells.
+*** Holes in the layout are marked solved with no value, so that the grid is
+*** solved when the solved counter reaches the number of cells.
+********************************************************************************/
+static struct grid *
+grid_zero(g, gr)
+  struct grid *g;
+  struct graph *gr;
+{
+  int i,k;
+  g->gr = gr;
+  for (i=0; i<gr->ncells; i++) {
+    if (gr->hole[i]) {
+      for (k=0; k<CELL_WORDS; k++) {
+        g->cells[i].w[k] = 0;
+      }
+      g->cells[i].w[0] = SOLVED;
+    }
+    else {
+      open_cell(&g->cells[i]);
+    }
+  }
+  g->solved_counter = gr->nholes;
+  return g;
+}
+
+
+/********************************************************************************
+*** Allocates an initialised grid for a graph. Returns NULL if there's no memory.
+********************************************************************************/
+static struct grid *
+new_grid(gr)
+  struct graph *gr;
+{
+  struct grid *g;
+  g = (struct grid *) malloc(GRID_SIZE(gr));
+  if (g == NULL) {
+    return NULL;
+  }
+  return grid_zero(g, gr);
+}
+
+
+/********************************************************************************
+*** Make an exact copy of game state from one grid to another.
+********************************************************************************/
+static void
+copy_grid(sg, dg)
+  struct grid *sg;
+  struct grid *dg;
+{
+  dg->gr = sg->gr;
+  memcpy(dg->cells, sg->cells, sg->gr->ncells * sizeof(struct cell));
+  dg->solved_counter = sg->solved_counter;
+}
+
+
+
+/********************************************************************************
+*** Setter and getter functions for individual cells.
+********************************************************************************/
+static void
+set_value(c, value)
+  struct cell *c;
+  int value;
+{
+  int k;
+  for (k=0; k<CELL_WORDS; k++) {
+    c->w[k] = 0;
+  }
+  c->w[WORD(value)] = BIT(value);
+  c->w[0] |= SOLVED;
+}
+
+static int
+get_value(c)
+  struct cell *c;
+{
+  int k;
+  CELL_WORD w;
+  if (c->w[0] & SOLVED) {
+    /* solved: find the first (and only) possible value */
+    for (k=0; k<CELL_WORDS; k++) {
+      w = k == 0 ? c->w[0] & ~(CELL_WORD)SOLVED : c->w[k];
+      if (w) return k*WORD_BITS + FFS(w);
+    }
+  }
+  return 0;   /* returns 0 if unsolved */
+}
+
+
+/********************************************************************************
+*** Count the possible values of a cell (the solved flag is not counted).
+********************************************************************************/
+static int
+count_possibles(c)
+  struct cell *c;
+{
+  int k,n;
+  n = POPCOUNT(c->w[0] & ~(CELL_WORD)SOLVED);
+  for (k=1; k<CELL_WORDS; k++) {
+    n += POPCOUNT(c->w[k]);
+  }
+  return n;
+}
+ 
+
+/********************************************************************************
+*** Set solved flag if the cell is solved (has only one possible value).
+********************************************************************************/
+static void
+mark_if_solved(c)
+  struct cell *c;
+{
+  if (count_possibles(c) == 1) c->w[0] |= SOLVED;
+}
+
+
+/********************************************************************************
+*** Clears the possible values in mask from a target cell, if it has any of them.
+*** Returns 1 if the cell changed, 0 if not, or -1 if the cell has been wiped out
+*** with no possible solution. The solved counter of the grid is kept up to date.
+********************************************************************************/
+static int
+eliminate(g, cell, mask)
+  struct grid *g;
+  struct cell *cell;
+  struct cell *mask;
+{
+  int k;
+  CELL_WORD hit;
+
+  /* only touch the cell if it contains one of the values being cleared */
+  hit = 0;
+  for (k=0; k<CELL_WORDS; k++) {
+    hit |= cell->w[k] & mask->w[k];
+  }
+  if (hit == 0) {
+    return 0;
+  }
+
+  for (k=0; k<CELL_WORDS; k++) {
+    cell->w[k] &= ~mask->w[k];
+  }
+  if (count_possibles(cell) == 0) {
+    /* -1 signals to calling function that this grid is invalid */
+    return -1;
+  }
+  if (!(cell->w[0] & SOLVED)) {
+    mark_if_solved(cell);
+    /* and if we have solved a cell, increment the solved cells counter */
+    if (cell->w[0] & SOLVED) {
+      g->solved_counter++;
+    }
+  }
+  return 1;
+}
+
+ 
+/********************************************************************************
+*** Where we have a solved cell, this helper function will clear this value from
+*** connected cells (its peers in the constraint graph) of the source cell.
+*** Returns the number of cell changes it made, or -1 if the grid is invalid
+*** (ie at least one cell is wiped out with no possible solution).
+********************************************************************************/
+static int
+reduce(g, source)
+  struct grid *g;
+  int source;
+{
+  struct cell mask;
+  int changed;
+  int p,r;
+  int *peers;
+
+  /* return immediately if the source cell is not already solved */
+  if ((g->cells[source].w[0] & SOLVED) == 0) {
+    return 0;
+  }
+
+  /* the mask is the solved value, without the solved flag */
+  mask = g->cells[source];
+  mask.w[0] &= ~(CELL_WORD)SOLVED;
+  changed = 0;
+
+  peers = g->gr->peers;
+  for (p=g->gr->peer_start[source]; p<g->gr->peer_start[source+1]; p++) {
+    if ((r = eliminate(g, &g->cells[peers[p]], &mask)) == -1) return -1;
+    changed += r;
+  }
+  /* return the number of possibles we cleared */
+  return changed;
+}
+
+
+/********************************************************************************
+*** Killer cages: the values in a cage must add up to its sum. Every set of values
+*** that could fill the unsolved cells of a cage is looked up in the table of
+*** combinations for that number of cells and remaining sum. Sets using a value
+*** that is already placed in the cage, or one that none of the unsolved cells
+*** can take, are skipped, and the cells lose any value not in one of the rest.
+*** Returns the number of cell changes it made, or -1 if the grid is invalid.
+********************************************************************************/
+static int
+reduce_cages(g)
+  struct grid *g;
+{
+  struct graph *gr;
+  struct cell *c;
+  struct cell mask;
+  CELL_WORD used,avail,allowed;
+  int i,k,p,q,n,v,sum,r,changed;
+
+  gr = g->gr;
+  changed = 0;
+  for (k=0; k<CELL_WORDS; k++) {
+    mask.w[k] = 0;
+  }
+  for (i=0; i<gr->ncages; i++) {
+    /* what's left of the cage once the solved cells are taken out */
+    used = 0;
+    avail = 0;
+    n = 0;
+    sum = gr->cage_sum[i];
+    for (p=gr->cage_start[i]; p<gr->cage_start[i+1]; p++) {
+      c = &g->cells[gr->cage_cells[p]];
+      if (c->w[0] & SOLVED) {
+        v = get_value(c);
+        sum -= v;
+        used |= BIT(v);
+      }
+      else {
+        avail |= c->w[0];
+        n++;
+      }
+    }
+    if ((sum < 0) || (sum > MAX_SUM)) {
+      return -1;
+    }
+    if (n == 0) {
+      /* a full cage has to add up exactly */
+      if (sum != 0) return -1;
+      continue;
+    }
+
+    /* join up the sets of values that can still fill the cage */
+    allowed = 0;
+    q = n*(MAX_SUM+1) + sum;
+    for (p=gr->combo_start[q]; p<gr->combo_start[q+1]; p++) {
+      if (((gr->combos[p] & used) == 0) && ((gr->combos[p] & ~avail) == 0)) {
+        allowed |= gr->combos[p];
+      }
+    }
+    if (allowed == 0) {
+      return -1;
+    }
+
+    /* and clear anything else from the unsolved cells */
+    mask.w[0] = ~(allowed | SOLVED);
+    for (p=gr->cage_start[i]; p<gr->cage_start[i+1]; p++) {
+      c = &g->cells[gr->cage_cells[p]];
+      if (c->w[0] & SOLVED) continue;
+      if ((r = eliminate(g, c, &mask)) == -1) return -1;
+      changed += r;
+    }
+  }
+  return changed;
+}
+
+
+/********************************************************************************
+*** Uses reduce() to remove possible values from unsolved cells.
+*** Checks every cell in a grid.
+********************************************************************************/
+static int
+reduce_grid(g)
+  struct grid *g;
+{
+  int i;
+  int r,reductions;
+  r = 0;
+  reductions = 0;
+  /* iterate through every cell */
+  for (i=0; i<g->gr->ncells; i++) {
+    /* the reduce() function removes solved cells from possible solutions in
+    ** unsolved cells in the grid */
+    r = reduce(g,i);
+    if (r == -1) {
+      /* return early if we have an unsolveable cell */
+      return -1;
+    }
+    reductions = reductions + r;
+  }
+  /* the killer cages can rule out more values */
+  if (g->gr->ncages > 0) {
+    r = reduce_cages(g);
+    if (r == -1) {
+      return -1;
+    }
+    reductions = reductions + r;
+  }
+  return reductions; 
+}
+
+
+/********************************************************************************
+*** Chooses a cell with the lowest number of possible answers
+*** to help optimise the computation (ie find the right answer earlier).
+*** Checks every cell in the grid to find out how many possible answers each cell
+*** has and picks the one with the lowest number of possibles.
+*** Obvs. skips cells that are already solved
+********************************************************************************/
+static void
+choose_target_cell(g,t)
+  struct grid *g;
+  int *t;     /* the best target cell we found */
+{
+  int i;      /* current cell */
+  int tc;     /* best target found so far */
+  int a,n;    /* a is number of possibles of current cell, n is the number of possibles
+                 for best target so far */
+  n=MAX_VAL+1;  /* initialise n to a high number */
+  tc=0;
+  for (i=0; i<g->gr->ncells; i++) {
+    if (g->cells[i].w[0] & SOLVED) {
+      /* jump over this cell if it's already been solved */
+      continue;
+    }
+    /* figure out how many answers currently possible for this cell */
+    a = count_possibles(&g->cells[i]);
+    if (a<n) {
+      /* if we've got a cell with a lower number of possible answers than we found
+      ** so far, make this the target cell */
+      n = a;
+      tc = i;
+      /* two is as low as an unsolved cell goes, so stop looking */
+      if (n == 2) break;
+    }
+  }
+  /* return the best target cell we found */
+  *t = tc;
+}
+
+
+/********************************************************************************
+*** Creates an empty constraint graph for a layout of rows x cols cells.
+*** Returns NULL if we've run out of memory.
+********************************************************************************/
+static struct graph *
+new_graph(rows, cols)
+  int rows, cols;
+{
+  struct graph *gr;
+  gr = (struct graph *) calloc(1, sizeof(struct graph));
+  if (gr == NULL) {
+    return NULL;
+  }
+  gr->rows = rows;
+  gr->cols = cols;
+  gr->ncells = rows*cols;
+  gr->unit_start = (int *) calloc(1, sizeof(int));
+  if (gr->unit_start == NULL) {
+    free(gr);
+    return NULL;
+  }
+  return gr;
+}
+
+
+/********************************************************************************
+*** Frees a graph and everything in it.
+********************************************************************************/
+static void
+free_graph(gr)
+  struct graph *gr;
+{
+  if (gr != NULL) {
+    free(gr->hole);
+    free(gr->line_cell);
+    free(gr->unit_start);
+    free(gr->unit_cells);
+    free(gr->peer_start);
+    free(gr->peers);
+    free(gr->cage_sum);
+    free(gr->cage_start);
+    free(gr->cage_cells);
+    free(gr->combo_start);
+    free(gr->combos);
+    free(gr);
+  }
+}
+
+
+/********************************************************************************
+*** Adds a unit of n cells to a graph. The cells must all be different and there
+*** can't be more of them than there are values.
+*** Returns boolean success or failure.
+********************************************************************************/
+static int
+add_unit(gr, cells, n)
+  struct graph *gr;
+  int *cells;
+  int n;
+{
+  int i,j,used;
+  int *p;
+
+  if (n > MAX_VAL) {
+    return 0;
+  }
+  for (i=0; i<n; i++) {
+    if ((cells[i] < 0) || (cells[i] >= gr->ncells)) return 0;
+    for (j=0; j<i; j++) {
+      if (cells[i] == cells[j]) return 0;
+    }
+  }
+
+  /* make room for the new unit, doubling the arrays as they fill up */
+  used = gr->unit_start[gr->nunits];
+  if (used + n > gr->cells_room) {
+    gr->cells_room = 2*(used + n);
+    p = (int *) realloc(gr->unit_cells, gr->cells_room * sizeof(int));
+    if (p == NULL) return 0;
+    gr->unit_cells = p;
+  }
+  if (gr->nunits + 2 > gr->units_room) {
+    gr->units_room = 2*(gr->nunits + 2);
+    p = (int *) realloc(gr->unit_start, gr->units_room * sizeof(int));
+    if (p == NULL) return 0;
+    gr->unit_start = p;
+  }
+
+  memcpy(gr->unit_cells + used, cells, n * sizeof(int));
+  gr->nunits++;
+  gr->unit_start[gr->nunits] = used + n;
+  return 1;
+}
+
+
+/********************************************************************************
+*** Adds the units of a classic grid with its top left cell at row r0, column c0:
+*** line_units() adds every row and column, box_units() adds the R_ROWS x R_COLS
+*** boxes, diagonal_units() the two main diagonals (X-sudoku) and window_units()
+*** the extra windows of windoku, which sit one cell in from the boxes.
+*** All return boolean success or failure.
+********************************************************************************/
+static int
+line_units(gr, r0, c0)
+  struct graph *gr;
+  int r0,c0;
+{
+  int cells[MAX_VAL];
+  int i,j;
+
+  for (i=0; i<ROWS; i++) {
+    for (j=0; j<COLS; j++) cells[j] = (r0 + i)*gr->cols + c0 + j;
+    if (!add_unit(gr, cells, COLS)) return 0;
+  }
+  for (j=0; j<COLS; j++) {
+    for (i=0; i<ROWS; i++) cells[i] = (r0 + i)*gr->cols + c0 + j;
+    if (!add_unit(gr, cells, ROWS)) return 0;
+  }
+  return 1;
+}
+
+static int
+box_units(gr, r0, c0)
+  struct graph *gr;
+  int r0,c0;
+{
+  int cells[MAX_VAL];
+  int i,n;
+
+  for (n=0; n<MAX_VAL; n++) {
+    for (i=0; i<MAX_VAL; i++) {
+      cells[i] = (r0 + (n/(COLS/R_COLS))*R_ROWS + i/R_COLS)*gr->cols
+               + c0 + (n%(COLS/R_COLS))*R_COLS + i%R_COLS;
+    }
+    if (!add_unit(gr, cells, MAX_VAL)) return 0;
+  }
+  /* boxes line up with the printed separators only if the grid does */
+  gr->boxed = (r0%R_ROWS == 0) && (c0%R_COLS == 0)
+           && (gr->rows%R_ROWS == 0) && (gr->cols%R_COLS == 0);
+  return 1;
+}
+
+#ifdef SUD_PROGRAM
+static int
+diagonal_units(gr, r0, c0)
+  struct graph *gr;
+  int r0,c0;
+{
+  int cells[MAX_VAL];
+  int i;
+
+  for (i=0; i<ROWS; i++) cells[i] = (r0 + i)*gr->cols + c0 + i;
+  if (!add_unit(gr, cells, ROWS)) return 0;
+  for (i=0; i<ROWS; i++) cells[i] = (r0 + i)*gr->cols + c0 + COLS-1-i;
+  return add_unit(gr, cells, ROWS);
+}
+
+static int
+window_units(gr, r0, c0)
+  struct graph *gr;
+  int r0,c0;
+{
+  int cells[MAX_VAL];
+  int i,r,c;
+
+  for (r=1; r+R_ROWS<ROWS; r+=R_ROWS+1) {
+    for (c=1; c+R_COLS<COLS; c+=R_COLS+1) {
+      for (i=0; i<MAX_VAL; i++) {
+        cells[i] = (r0 + r + i/R_COLS)*gr->cols + c0 + c + i%R_COLS;
+      }
+      if (!add_unit(gr, cells, MAX_VAL)) return 0;
+    }
+  }
+  return 1;
+}
+
+
+/********************************************************************************
+*** Adds a killer cage of n cells whose values add up to sum. The cells of a cage
+*** must all be different too, so it goes in as a unit as well.
+*** Returns boolean success or failure.
+********************************************************************************/
+static int
+add_cage(gr, cells, n, sum)
+  struct graph *gr;
+  int *cells;
+  int n,sum;
+{
+  int *p;
+
+  if ((MAX_VAL > MAX_CAGE_VAL) || (sum < 1) || (sum > MAX_SUM)) {
+    return 0;
+  }
+  if (!add_unit(gr, cells, n)) {
+    return 0;
+  }
+  if (gr->cage_start == NULL) {
+    gr->cage_start = (int *) calloc(1, sizeof(int));
+    if (gr->cage_start == NULL) return 0;
+  }
+  p = (int *) realloc(gr->cage_start, (gr->ncages + 2) * sizeof(int));
+  if (p == NULL) return 0;
+  gr->cage_start = p;
+  p = (int *) realloc(gr->cage_sum, (gr->ncages + 1) * sizeof(int));
+  if (p == NULL) return 0;
+  gr->cage_sum = p;
+  p = (int *) realloc(gr->cage_cells, (gr->cage_start[gr->ncages] + n) * sizeof(int));
+  if (p == NULL) return 0;
+  gr->cage_cells = p;
+
+  memcpy(gr->cage_cells + gr->cage_start[gr->ncages], cells, n * sizeof(int));
+  gr->cage_sum[gr->ncages] = sum;
+  gr->cage_start[gr->ncages+1] = gr->cage_start[gr->ncages] + n;
+  gr->ncages++;
+  return 1;
+}
+#endif
+
+
+/********************************************************************************
+*** Builds the table of value combinations used by reduce_cages(): every set of
+*** different values, filed under its size and its sum.
+*** Returns boolean success or failure.
+********************************************************************************/
+static int
+build_combos(gr)
+  struct graph *gr;
+{
+  int *fill;
+  int m,k,n,sum,slots;
+
+  slots = (MAX_VAL+1)*(MAX_SUM+1);
+  gr->combo_start = (int *) calloc(slots + 1, sizeof(int));
+  gr->combos = (CELL_WORD *) malloc((NCOMBOS + 1) * sizeof(CELL_WORD));
+  fill = (int *) malloc(slots * sizeof(int));
+  if (!gr->combo_start || !gr->combos || !fill) {
+    free(fill);
+    return 0;
+  }
+
+  /* count the sets in each slot, then lay the slots out one after another */
+  for (m=1; m<NCOMBOS; m++) {
+    for (k=0, n=0, sum=0; k<MAX_VAL; k++) {
+      if (m & 1<<k) { n++; sum += k+1; }
+    }
+    gr->combo_start[n*(MAX_SUM+1) + sum + 1]++;
+  }
+  for (k=0; k<slots; k++) {
+    gr->combo_start[k+1] += gr->combo_start[k];
+    fill[k] = gr->combo_start[k];
+  }
+  for (m=1; m<NCOMBOS; m++) {
+    for (k=0, n=0, sum=0; k<MAX_VAL; k++) {
+      if (m & 1<<k) { n++; sum += k+1; }
+    }
+    /* value k+1 is bit k+1 of a cell */
+    gr->combos[fill[n*(MAX_SUM+1) + sum]++] = (CELL_WORD) m << 1;
+  }
+  free(fill);
+  return 1;
+}
+
+
+/********************************************************************************
+*** Compiles the units of a graph into the flat array of peers for each cell.
+*** Each peer is listed once, however many units it shares with the cell.
+*** Returns boolean success or failure.
+********************************************************************************/
+static int
+compile_graph(gr)
+  struct graph *gr;
+{
+  int *cell_start;     /* units of cell i are cell_units[cell_start[i]] ... */
+  int *cell_units;
+  int *seen;           /* last cell that each cell was counted as a peer of */
+  int i,u,p,q,n,pass;
+
+  cell_start = (int *) calloc(gr->ncells + 1, sizeof(int));
+  cell_units = (int *) malloc((gr->unit_start[gr->nunits] + 1) * sizeof(int));
+  seen = (int *) malloc(gr->ncells * sizeof(int));
+  gr->peer_start = (int *) calloc(gr->ncells + 1, sizeof(int));
+  gr->hole = (char *) calloc(gr->ncells, sizeof(char));
+  gr->line_cell = (int *) malloc(gr->ncells * sizeof(int));
+  if (!cell_start || !cell_units || !seen || !gr->peer_start || !gr->hole || !gr->line_cell) {
+    free(cell_start); free(cell_units); free(seen);
+    return 0;
+  }
+
+  /* turn the list of cells in each unit round into a list of units for each cell */
+  for (p=0; p<gr->unit_start[gr->nunits]; p++) {
+    cell_start[gr->unit_cells[p] + 1]++;
+  }
+  for (i=0; i<gr->ncells; i++) {
+    cell_start[i+1] += cell_start[i];
+  }
+  for (u=0; u<gr->nunits; u++) {
+    for (p=gr->unit_start[u]; p<gr->unit_start[u+1]; p++) {
+      cell_units[cell_start[gr->unit_cells[p]]++] = u;
+    }
+  }
+  for (i=gr->ncells; i>0; i--) {
+    cell_start[i] = cell_start[i-1];
+  }
+  cell_start[0] = 0;
+
+  /* a cell in no unit at all is a hole in the layout */
+  for (i=0; i<gr->ncells; i++) {
+    if (cell_start[i] == cell_start[i+1]) {
+      gr->hole[i] = 1;
+      gr->nholes++;
+    }
+    else {
+      gr->line_cell[i - gr->nholes] = i;
+    }
+  }
+
+  /* first pass counts the peers of each cell, the second fills them in */
+  for (pass=0; pass<2; pass++) {
+    for (i=0; i<gr->ncells; i++) seen[i] = -1;
+    n = 0;
+    for (i=0; i<gr->ncells; i++) {
+      seen[i] = i;
+      for (q=cell_start[i]; q<cell_start[i+1]; q++) {
+        u = cell_units[q];
+        for (p=gr->unit_start[u]; p<gr->unit_start[u+1]; p++) {
+          if (seen[gr->unit_cells[p]] == i) continue;
+          seen[gr->unit_cells[p]] = i;
+          if (pass == 1) gr->peers[n] = gr->unit_cells[p];
+          n++;
+        }
+      }
+      gr->peer_start[i+1] = n;
+    }
+    if (pass == 0) {
+      gr->peers = (int *) malloc((n + 1) * sizeof(int));
+      if (gr->peers == NULL) {
+        free(cell_start); free(cell_units); free(seen);
+        return 0;
+      }
+    }
+  }
+
+  free(cell_start); free(cell_units); free(seen);
+  return (gr->ncages == 0) || build_combos(gr);
+}
+
+
+/********************************************************************************
+*** Reads a puzzle written on one line of n characters (not counting the new line):
+*** one character for each cell, row by row and skipping holes, with the digit
+*** for a clue and a dot (.) or 0 for unknown.
+*** Grids with more than 9 values are written as numbers separated by spaces.
+*** Returns boolean success or failure.
+********************************************************************************/
+static int
+parse_line(g, p, n)
+  struct grid *g;
+  char *p;             /* the line */
+  int n;               /* its length */
+{
+  struct graph *gr;
+  int k;
+#if MAX_VAL <= 9
+  unsigned int digits,blanks;
+#ifdef PARSE_BLOCK
+  unsigned int all;
+#if PARSE_BLOCK == 32
+  __m256i x,d;
+#else
+  __m128i x,d;
+#endif
+#endif
+
+  gr = g->gr;
+  if (n != gr->ncells - gr->nholes) {
+    return 0;
+  }
+  k = 0;
+#ifdef PARSE_BLOCK
+  /* sort a block of characters at once into masks of digits 1-9 and blanks,
+  ** then set the clues straight into the grid a set bit at a time */
+  all = PARSE_BLOCK == 32 ? ~0U : 0xffff;
+  for (; k+PARSE_BLOCK<=n; k+=PARSE_BLOCK) {
+#if PARSE_BLOCK == 32
+    x = _mm256_loadu_si256((__m256i *) (p + k));
+    d = _mm256_sub_epi8(x, _mm256_set1_epi8('1'));
+    digits = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(8)), d));
+    blanks = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('.')),
+                                                  _mm256_cmpeq_epi8(x, _mm256_set1_epi8('0'))));
+#else
+    x = _mm_loadu_si128((__m128i *) (p + k));
+    d = _mm_sub_epi8(x, _mm_set1_epi8('1'));
+    digits = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(8)), d));
+    blanks = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('.')),
+                                            _mm_cmpeq_epi8(x, _mm_set1_epi8('0'))));
+#endif
+    if ((digits | blanks) != all) {
+      return 0;
+    }
+    while (digits) {
+      set_value(&g->cells[gr->line_cell[k + FFS(digits)]], p[k + FFS(digits)] - '0');
+      g->solved_counter++;
+      digits &= digits - 1;
+    }
+  }
+#endif
+  /* whatever is left, a character at a time */
+  for (; k<n; k++) {
+    if ((p[k] >= '1') && (p[k] <= '9')) {
+      set_value(&g->cells[gr->line_cell[k]], p[k] - '0');
+      g->solved_counter++;
+    }
+    else if ((p[k] != '.') && (p[k] != '0')) {
+      return 0;
+    }
+  }
+  return 1;
+#else
+  int v;
+  char *end;
+
+  gr = g->gr;
+  end = p + n;
+  for (k=0; k<gr->ncells - gr->nholes; k++) {
+    while ((p < end) && (*p == ' ')) p++;
+    if (p == end) {
+      return 0;
+    }
+    if (*p == '.') {
+      v = 0;
+      p++;
+    }
+    else {
+      for (v=0; (p < end) && (*p >= '0') && (*p <= '9'); p++) {
+        v = v*10 + *p - '0';
+      }
+    }
+    if (((p < end) && (*p != ' ')) || (v > MAX_VAL)) {
+      return 0;
+    }
+    if (v > 0) {
+      set_value(&g->cells[gr->line_cell[k]], v);
+      g->solved_counter++;
+    }
+  }
+  /* anything left over means the line doesn't fit the puzzle */
+  while ((p < end) && (*p == ' ')) p++;
+  return p == end;
+#endif
+}
+
+
+/********************************************************************************
+*** Writes a grid into p in the one line format read by parse_line(), without
+*** a new line. Returns the number of characters written.
+********************************************************************************/
+static int
+format_line(g, p)
+  struct grid *g;
+  char *p;             /* room for 4 characters a cell */
+{
+  int i,v;
+  char *start;
+  struct graph *gr;
+  gr = g->gr;
+  start = p;
+  for (i=0; i<gr->ncells; i++) {
+    if (gr->hole[i]) continue;
+    v = get_value(&g->cells[i]);
+#if MAX_VAL <= 9
+    *p++ = v ? '0' + v : '.';
+#else
+    if (p != start) *p++ = ' ';
+    if (v == 0) *p++ = '.';
+    if (v >= 100) *p++ = '0' + v/100;
+    if (v >= 10) *p++ = '0' + v/10%10;
+    if (v > 0) *p++ = '0' + v%10;
+#endif
+  }
+  return p - start;
+}
+
+
+/********************************************************************************
+*** Packed format, for archives too big to keep as text. A packed file starts
+*** with a header: "SUDP", a version byte, the number of bits in a value, two
+*** spare bytes and the number of cells in a puzzle (not counting holes) as 4
+*** bytes, least significant first. Then each puzzle is a record: a mask with a
+*** bit for every cell, in the order of the one line format, set for the clues;
+*** then the clues one after another, each as its value less one in PACK_BITS
+*** bits. Both parts are packed least significant bit first and padded to a whole
+*** byte, so a classic puzzle with 17 clues takes 20 bytes and a solution 52,
+*** against 82 as a line. A record with no clues is a puzzle that wasn't solved.
+********************************************************************************/
+#define PACK_MAGIC "SUDP"
+#define PACK_VERSION 1
+#define PACK_HEADER 12
+#define PACK_BITS (MAX_VAL <= 2 ? 1 : MAX_VAL <= 4 ? 2 : MAX_VAL <= 8 ? 3 : MAX_VAL <= 16 ? 4 : \
+                   MAX_VAL <= 32 ? 5 : MAX_VAL <= 64 ? 6 : MAX_VAL <= 128 ? 7 : 8)
+#define MASK_SIZE(gr) (((gr)->ncells - (gr)->nholes + 7) / 8)
+
+/* numbers are stored n bytes long, least significant first */
+#ifdef SUD_PROGRAM
+static void
+put_number(p, v, n)
+  unsigned char *p;
+  long v;
+  int n;
+{
+  int k;
+  for (k=0; k<n; k++) {
+    p[k] = v >> (8*k);
+  }
+}
+#endif
+
+static long
+get_number(p, n)
+  unsigned char *p;
+  int n;
+{
+  unsigned long v;
+  /* unsigned, as an 8 byte hash can fill the top bit */
+  for (v=0; n>0; n--) {
+    v = (v << 8) | p[n-1];
+  }
+  return (long) v;
+}
+
+
+#ifdef SUD_PROGRAM
+/********************************************************************************
+*** Writes the header of a packed file of puzzles into p.
+*** Returns the number of characters written.
+********************************************************************************/
+static int
+pack_header(gr, p)
+  struct graph *gr;
+  unsigned char *p;
+{
+  memcpy(p, PACK_MAGIC, 4);
+  p[4] = PACK_VERSION;
+  p[5] = PACK_BITS;
+  p[6] = p[7] = 0;
+  put_number(p + 8, (long) (gr->ncells - gr->nholes), 4);
+  return PACK_HEADER;
+}
+
+
+/********************************************************************************
+*** Checks that p starts with the header of a packed file of puzzles that fit
+*** the graph. Returns boolean success or failure.
+********************************************************************************/
+static int
+check_header(gr, p)
+  struct graph *gr;
+  unsigned char *p;
+{
+  return (memcmp(p, PACK_MAGIC, 4) == 0) && (p[4] == PACK_VERSION) && (p[5] == PACK_BITS)
+      && (get_number(p + 8, 4) == gr->ncells - gr->nholes);
+}
+
+
+/********************************************************************************
+*** Returns the length of the packed record at p, from its mask.
+********************************************************************************/
+static long
+record_size(gr, p)
+  struct graph *gr;
+  unsigned char *p;
+{
+  long clues;
+  int i;
+  for (clues=0, i=0; i<MASK_SIZE(gr); i++) {
+    clues += POPCOUNT((CELL_WORD) p[i]);
+  }
+  return MASK_SIZE(gr) + (clues*PACK_BITS + 7) / 8;
+}
+
+
+/********************************************************************************
+*** Writes the clues of a grid (every cell, if it is solved) into p as a packed
+*** record, or an empty record if g is NULL. Returns its length.
+********************************************************************************/
+static int
+pack_grid(gr, g, p)
+  struct graph *gr;
+  struct grid *g;
+  unsigned char *p;
+{
+  unsigned char *q;
+  unsigned int acc;
+  int k,v,nbits;
+
+  memset(p, 0, MASK_SIZE(gr));
+  if (g == NULL) {
+    return MASK_SIZE(gr);
+  }
+  q = p + MASK_SIZE(gr);
+  acc = 0;
+  nbits = 0;
+  for (k=0; k<gr->ncells - gr->nholes; k++) {
+    if ((v = get_value(&g->cells[gr->line_cell[k]])) == 0) continue;
+    p[k/8] |= 1 << (k%8);
+    acc |= (v - 1) << nbits;
+    for (nbits+=PACK_BITS; nbits>=8; nbits-=8) {
+      *q++ = acc;
+      acc >>= 8;
+    }
+  }
+  if (nbits > 0) *q++ = acc;
+  return q - p;
+}
+
+
+/********************************************************************************
+*** Reads a packed record of n characters into the grid, as parse_line() does a
+*** line. Returns boolean success or failure.
+********************************************************************************/
+static int
+unpack_grid(g, p, n)
+  struct grid *g;
+  unsigned char *p;
+  long n;
+{
+  struct graph *gr;
+  unsigned char *q;
+  unsigned int acc;
+  int k,v,nbits;
+
+  gr = g->gr;
+  if ((n < MASK_SIZE(gr)) || (n != record_size(gr, p))) {
+    return 0;
+  }
+  q = p + MASK_SIZE(gr);
+  acc = 0;
+  nbits = 0;
+  for (k=0; k<gr->ncells - gr->nholes; k++) {
+    if (!(p[k/8] & (1 << (k%8)))) continue;
+    if (nbits < PACK_BITS) {
+      acc |= *q++ << nbits;
+      nbits += 8;
+    }
+    v = (acc & ((1 << PACK_BITS) - 1)) + 1;
+    acc >>= PACK_BITS;
+    nbits -= PACK_BITS;
+    if (v > MAX_VAL) {
+      return 0;
+    }
+    set_value(&g->cells[gr->line_cell[k]], v);
+    g->solved_counter++;
+  }
+  return 1;
+}
+#endif
+
+
+/********************************************************************************
+*** Canonical form. Two classic grids are the same puzzle if one turns into the
+*** other by permuting the bands (the rows of boxes), the rows within a band,
+*** the stacks (the columns of boxes) and the columns within a stack, by
+*** transposing (if the boxes are square) and by relabelling the values. The
+*** canonical form of a grid is the smallest grid it can be turned into, with
+*** an unknown cell bigger than any value and the values relabelled in the order
+*** they first appear, so every grid of a puzzle has the same one. It works for clues and
+*** solutions alike. The top band is read column by column and the rest of the
+*** grid row by row, so that the order of the columns, which is the biggest
+*** choice, is settled a column at a time against the best result so far.
+*** The search first takes the rows of the top band, then its columns one by
+*** one, then each row after it, only following the choices that give the
+*** smallest row, and drops any choice as soon as it falls behind. Rows or
+*** columns that are the same all the way along, and in the same band or
+*** stack, can be swapped without changing anything, so only the first of
+*** them is tried.
+********************************************************************************/
+#define BANDS (ROWS/R_ROWS)
+#define STACKS (COLS/R_COLS)
+#define UNKNOWN (MAX_VAL+1)    /* an unknown cell comes after any value */
+
+struct transform {
+  int transpose;        /* set if the grid is transposed first, */
+  int row[ROWS];        /* then row r comes from row row[r], */
+  int col[COLS];        /* column c from column col[c], */
+  int map[MAX_VAL+1];   /* and value v becomes map[v] */
+};
+
+struct canon {
+  int v[ROWS*COLS];               /* the values of the grid, */
+  int vt[ROWS*COLS];              /* and of its transpose */
+  int *in;                        /* whichever of them is being searched */
+  int twin_row[ROWS];             /* the row before that's the same, or -1, */
+  int twin_col[COLS];             /* and the column */
+  struct transform t;             /* the transform being tried, */
+  int maps[ROWS][MAX_VAL+1];      /* the labels as of each row, */
+  int next[ROWS];                 /* the next label after each row, */
+  int cur[ROWS*COLS];             /* and the result */
+  int row_buf[COLS];
+  int used_row[ROWS],used_band[BANDS];
+  int used_col[COLS],used_stack[STACKS];
+  int best[ROWS*COLS];            /* the smallest result found, */
+  struct transform bt;            /* and its transform */
+  int found;                      /* set once there is one */
+  long updates;                   /* number of times it has changed */
+};
+
+
+/********************************************************************************
+*** Returns boolean whether a graph has just the classic rules, the only ones
+*** with the symmetries of the canonical form.
+********************************************************************************/
+static int
+classic_rules(gr)
+  struct graph *gr;
+{
+  return (gr->rows == ROWS) && (gr->cols == COLS) && (gr->nholes == 0) && gr->boxed
+      && (gr->nunits == 3*MAX_VAL) && (gr->ncages == 0);
+}
+
+
+/* compares two rows of n values, returning <0, 0 or >0 as strcmp() does */
+static int
+compare_row(a, b, n)
+  int *a,*b;
+  int n;
+{
+  int j;
+  for (j=0; j<n; j++) {
+    if (a[j] != b[j]) return a[j] - b[j];
+  }
+  return 0;
+}
+
+
+/********************************************************************************
+*** Finds the rows and columns of the grid being searched that are the same as
+*** one before them in the same band or stack.
+********************************************************************************/
+static void
+find_twins(c)
+  struct canon *c;
+{
+  int x,y,i;
+  for (x=0; x<ROWS; x++) {
+    c->twin_row[x] = -1;
+    for (y=x-1; (y>=0) && (y/R_ROWS == x/R_ROWS); y--) {
+      if (compare_row(c->in + x*COLS, c->in + y*COLS, COLS) == 0) {
+        c->twin_row[x] = y;
+        break;
+      }
+    }
+  }
+  for (x=0; x<COLS; x++) {
+    c->twin_col[x] = -1;
+    for (y=x-1; (y>=0) && (y/R_COLS == x/R_COLS); y--) {
+      for (i=0; (i<ROWS) && (c->in[i*COLS + x] == c->in[i*COLS + y]); i++);
+      if (i == ROWS) {
+        c->twin_col[x] = y;
+        break;
+      }
+    }
+  }
+}
+
+
+/********************************************************************************
+*** Row x can be row k of the result if its band is the one being filled, or
+*** starts a band not yet used; and it's left out if a twin could be instead.
+*** Likewise column x as column k.
+********************************************************************************/
+static int
+row_fits(c, x, k)
+  struct canon *c;
+  int x,k;
+{
+  int y;
+  if (k%R_ROWS == 0 ? c->used_band[x/R_ROWS] : (c->used_row[x] || (x/R_ROWS != c->t.row[k-1]/R_ROWS))) {
+    return 0;
+  }
+  for (y=c->twin_row[x]; y>=0; y=c->twin_row[y]) {
+    if (!c->used_row[y]) return 0;
+  }
+  return 1;
+}
+
+static int
+col_fits(c, x, k)
+  struct canon *c;
+  int x,k;
+{
+  int y;
+  if (k%R_COLS == 0 ? c->used_stack[x/R_COLS] : (c->used_col[x] || (x/R_COLS != c->t.col[k-1]/R_COLS))) {
+    return 0;
+  }
+  for (y=c->twin_col[x]; y>=0; y=c->twin_col[y]) {
+    if (!c->used_col[y]) return 0;
+  }
+  return 1;
+}
+
+
+/********************************************************************************
+*** Relabels row x as row k of the result into out, taking new labels from where
+*** the row before left off.
+********************************************************************************/
+static void
+relabel_row(c, x, k, out)
+  struct canon *c;
+  int x,k;
+  int *out;
+{
+  int j,v,*map,next;
+  map = c->maps[k];
+  memcpy(map, c->maps[k-1], (MAX_VAL+1) * sizeof(int));
+  next = c->next[k-1];
+  for (j=0; j<COLS; j++) {
+    if ((v = c->in[x*COLS + c->t.col[j]]) == 0) {
+      v = UNKNOWN;
+    }
+    else {
+      if (map[v] == 0) map[v] = next++;
+      v = map[v];
+    }
+    out[j] = v;
+  }
+  c->next[k] = next;
+}
+
+
+/********************************************************************************
+*** Chooses row k of the result, and the rows after it. less is set if the rows
+*** before are already smaller than the best result. Whenever the best result
+*** changes it's because of a choice made below here, so the rows before are
+*** then the same as the best's.
+********************************************************************************/
+static void
+canon_rows(c, k, less)
+  struct canon *c;
+  int k;
+  int less;
+{
+  int ties[ROWS];        /* the choices that give the smallest row */
+  int x,i,n,cmp,*low;
+  long updates;
+
+  if (k == ROWS) {
+    if (!c->found || less) {
+      memcpy(c->best, c->cur, sizeof(c->best));
+      c->bt = c->t;
+      memcpy(c->bt.map, c->maps[ROWS-1], sizeof(c->bt.map));
+      c->found = 1;
+      c->updates++;
+    }
+    return;
+  }
+
+  /* the smallest row any choice gives */
+  low = c->cur + k*COLS;
+  for (n=0, x=0; x<ROWS; x++) {
+    if (!row_fits(c, x, k)) continue;
+    relabel_row(c, x, k, n == 0 ? low : c->row_buf);
+    cmp = n == 0 ? -1 : compare_row(c->row_buf, low, COLS);
+    if (cmp < 0) {
+      if (n > 0) memcpy(low, c->row_buf, COLS * sizeof(int));
+      n = 0;
+    }
+    if (cmp <= 0) ties[n++] = x;
+  }
+  if (c->found && !less) {
+    if ((cmp = compare_row(low, c->best + k*COLS, COLS)) > 0) {
+      return;
+    }
+    less = cmp < 0;
+  }
+
+  /* and each choice that gives it */
+  updates = c->updates;
+  for (i=0; i<n; i++) {
+    x = ties[i];
+    relabel_row(c, x, k, c->row_buf);
+    if (c->updates != updates) {
+      less = 0;
+      updates = c->updates;
+    }
+    c->t.row[k] = x;
+    c->used_row[x] = c->used_band[x/R_ROWS] = 1;
+    canon_rows(c, k + 1, less);
+    c->used_row[x] = 0;
+    if (k%R_ROWS == 0) c->used_band[x/R_ROWS] = 0;
+  }
+}
+
+
+/********************************************************************************
+*** Chooses column k of the result, and the columns after it, which between them
+*** make the top band; then goes on to the other rows.
+********************************************************************************/
+static void
+canon_cols(c, k, less)
+  struct canon *c;
+  int k;
+  int less;
+{
+  int fresh[R_ROWS];    /* the values first labelled in this column */
+  int x,i,v,nfresh,cmp,*map;
+  long updates;
+
+  if (k == COLS) {
+    canon_rows(c, R_ROWS, less);
+    return;
+  }
+  map = c->maps[R_ROWS-1];
+  updates = c->updates;
+  for (x=0; x<COLS; x++) {
+    if (!col_fits(c, x, k)) continue;
+    if (c->updates != updates) {
+      less = 0;
+      updates = c->updates;
+    }
+    nfresh = 0;
+    cmp = 0;
+    for (i=0; i<R_ROWS; i++) {
+      if ((v = c->in[c->t.row[i]*COLS + x]) == 0) {
+        v = UNKNOWN;
+      }
+      else {
+        if (map[v] == 0) {
+          map[v] = c->next[R_ROWS-1]++;
+          fresh[nfresh++] = v;
+        }
+        v = map[v];
+      }
+      c->cur[i*COLS + k] = v;
+      if (c->found && (cmp == 0)) cmp = v - c->best[i*COLS + k];
+    }
+    if (!c->found || less || (cmp <= 0)) {
+      c->t.col[k] = x;
+      c->used_col[x] = c->used_stack[x/R_COLS] = 1;
+      canon_cols(c, k + 1, less || (cmp < 0));
+      c->used_col[x] = 0;
+      if (k%R_COLS == 0) c->used_stack[x/R_COLS] = 0;
+    }
+    for (i=0; i<nfresh; i++) {
+      map[fresh[i]] = 0;
+    }
+    c->next[R_ROWS-1] -= nfresh;
+  }
+}
+
+
+/********************************************************************************
+*** Chooses row k of the top band, and the rows after it in the band; then goes
+*** on to the columns.
+********************************************************************************/
+static void
+canon_band(c, k)
+  struct canon *c;
+  int k;
+{
+  int x;
+  if (k == R_ROWS) {
+    memset(c->maps[R_ROWS-1], 0, sizeof(c->maps[0]));
+    c->next[R_ROWS-1] = 1;
+    canon_cols(c, 0, 0);
+    return;
+  }
+  for (x=0; x<ROWS; x++) {
+    if (!row_fits(c, x, k)) continue;
+    c->t.row[k] = x;
+    c->used_row[x] = c->used_band[x/R_ROWS] = 1;
+    canon_band(c, k + 1);
+    c->used_row[x] = 0;
+    if (k%R_ROWS == 0) c->used_band[x/R_ROWS] = 0;
+  }
+}
+
+
+/********************************************************************************
+*** Finds the canonical form of a grid of the classic rules and the transform
+*** that turns the grid into it. Values the grid doesn't have are given the
+*** labels left over, so the transform turns a solution of the grid into a
+*** solution of its canonical form as well.
+*** Returns boolean success or failure (if the rules aren't classic).
+********************************************************************************/
+static int
+canonical_form(c, g, t)
+  struct canon *c;
+  struct grid *g;
+  struct transform *t;
+{
+  int i,j,v,tr,next;
+
+  if (!classic_rules(g->gr)) {
+    return 0;
+  }
+  for (i=0; i<ROWS*COLS; i++) {
+    c->v[i] = get_value(&g->cells[i]);
+  }
+  for (i=0; i<ROWS; i++) {
+    for (j=0; j<COLS; j++) c->vt[j*COLS + i] = c->v[i*COLS + j];
+  }
+  memset(c->used_row, 0, sizeof(c->used_row));
+  memset(c->used_band, 0, sizeof(c->used_band));
+  memset(c->used_col, 0, sizeof(c->used_col));
+  memset(c->used_stack, 0, sizeof(c->used_stack));
+  c->found = 0;
+  for (tr=0; tr<=(R_ROWS == R_COLS); tr++) {
+    c->in = tr ? c->vt : c->v;
+    c->t.transpose = tr;
+    find_twins(c);
+    canon_band(c, 0);
+  }
+
+  *t = c->bt;
+  for (next=1, v=1; v<=MAX_VAL; v++) {
+    if (t->map[v] >= next) next = t->map[v] + 1;
+  }
+  for (v=1; v<=MAX_VAL; v++) {
+    if (t->map[v] == 0) t->map[v] = next++;
+  }
+  t->map[0] = 0;
+  return 1;
+}
+
+
+/********************************************************************************
+*** Applies a transform to the grid g, or undoes it if back is set, filling in
+*** the grid tg of the same graph.
+********************************************************************************/
+static void
+transform_grid(t, g, tg, back)
+  struct transform *t;
+  struct grid *g;
+  struct grid *tg;
+  int back;
+{
+  int unmap[MAX_VAL+1];
+  int r,c,from,to,v;
+
+  for (v=0; v<=MAX_VAL; v++) {
+    unmap[t->map[v]] = v;
+  }
+  grid_zero(tg, tg->gr);
+  for (r=0; r<ROWS; r++) {
+    for (c=0; c<COLS; c++) {
+      /* cell r,c of the result comes from cell from of the grid */
+      to = r*COLS + c;
+      from = t->transpose ? t->col[c]*COLS + t->row[r] : t->row[r]*COLS + t->col[c];
+      if (back) {
+        v = unmap[get_value(&g->cells[to])];
+        to = from;
+      }
+      else {
+        v = t->map[get_value(&g->cells[from])];
+      }
+      if (v) {
+        set_value(&tg->cells[to], v);
+        tg->solved_counter++;
+      }
+    }
+  }
+}
+
+
+/********************************************************************************
+*** A solver holds the working state of a search, so that every thread solving
+*** puzzles has one of its own: the working grids for each level of the recursive
+*** search in try(), and statistics of the search. The grids for the first levels
+*** come from one arena allocated with the solver, which for the classic sizes
+*** holds as many levels as any search can need (one for each cell it can guess
+*** and one more), so solving one puzzle after another allocates nothing at all.
+*** Bigger grids get as many levels as fit in ARENA_SIZE, and a search that goes
+*** deeper than that allocates another level's grid the first time it gets that
+*** deep and keeps it from then on. Either way a large grid never has to live on
+*** the C stack and the only per-node cost is the copy.
+********************************************************************************/
+#define ARENA_SIZE (1<<20)
+#define ARENA_LEVELS 8         /* the fewest levels in the arena, however big */
+
+struct solver {
+  struct grid **work_grids;
+  int work_room;         /* number of levels we have room for */
+  int work_depth;
+  char *arena;           /* the grids of the first levels, */
+  int arena_levels;      /* and how many of them there are */
+  int failed;            /* why the search gave up: SUD_NO_MEMORY, SUD_BUDGET or SUD_CANCELLED */
+  long nodes;            /* grids tried, */
+  long guesses;          /* guesses made, */
+  int max_depth;         /* and the deepest level reached, since the last reset */
+  struct sud_budget budget;  /* limits on each search, 0 for none */
+  long node_limit;       /* the count of nodes at which this search stops, */
+  struct timespec deadline;  /* and the time */
+  int budget_kept;       /* set for a search to go on with the budget already started */
+  int cancel;            /* set from any thread to stop the search */
+  struct canon *canon;   /* room to find canonical forms, with the classic rules, */
+  struct grid *canon_grid;  /* a canonical grid, */
+  unsigned char *key;    /* and its values and those of its solution, */
+  unsigned char *sol;
+  struct sud_cache *cache;  /* for the cache of solutions, if there is one, */
+  unsigned char *store;  /* and the table of the solution store, if any, */
+  long store_slots;      /* and how many slots it has */
+  int keyed;             /* set if key and sol are those of the last puzzle */
+  long want;             /* the solutions to find before stopping, */
+  long found;            /* and how many have been found */
+  struct dead_end *dead; /* the table of dead ends, if any, */
+  long dead_sets;        /* its number of sets, */
+  unsigned long long *zobrist;  /* the key of each value of each cell, */
+  long dead_hits;        /* and how many have been found in it */
+  int shuffle;           /* set to guess values in a random order */
+  unsigned long long seed;  /* for random numbers */
+  int *order;            /* room for a list of the cells */
+  struct grid *differ;   /* a solution to look past, if any */
+  void (*each)();        /* called as (each_arg, g) with every solution counted, if set */
+  char *each_arg;
+};
+
+
+/********************************************************************************
+*** Frees a solver and its working grids.
+********************************************************************************/
+static void
+free_solver(s)
+  struct solver *s;
+{
+  int k;
+  if (s != NULL) {
+    for (k=s->arena_levels; k<s->work_room; k++) {
+      free(s->work_grids[k]);
+    }
+    free(s->work_grids);
+    free(s->arena);
+    free(s->canon);
+    free(s->canon_grid);
+    free(s->key);
+    free(s->dead);
+    free(s->zobrist);
+    free(s->order);
+    free(s);
+  }
+}
+
+
+/********************************************************************************
+*** Makes a new solver for the puzzles of a graph, with its arena of levels.
+*** Returns NULL if there's no memory.
+********************************************************************************/
+static struct solver *
+new_solver(gr)
+  struct graph *gr;
+{
+  struct solver *s;
+  int k,n;
+
+  if ((s = (struct solver *) calloc(1, sizeof(struct solver))) == NULL) {
+    return NULL;
+  }
+  n = ARENA_SIZE / GRID_SIZE(gr);
+  if (n > gr->ncells + 1) n = gr->ncells + 1;
+  if (n < ARENA_LEVELS) n = ARENA_LEVELS;
+  s->arena = (char *) malloc(n * GRID_SIZE(gr));
+  s->work_grids = (struct grid **) calloc(n, sizeof(struct grid *));
+  s->order = (int *) malloc(gr->ncells * sizeof(int));
+  if (classic_rules(gr)) {
+    s->canon = (struct canon *) malloc(sizeof(struct canon));
+    s->canon_grid = new_grid(gr);
+    s->key = (unsigned char *) malloc(2*ROWS*COLS);
+    s->sol = s->key + ROWS*COLS;
+  }
+  if ((s->arena == NULL) || (s->work_grids == NULL) || (s->order == NULL)
+      || (classic_rules(gr) && ((s->canon == NULL) || (s->canon_grid == NULL) || (s->key == NULL)))) {
+    free(s->arena);
+    free(s->work_grids);
+    free(s->order);
+    free(s->canon);
+    free(s->canon_grid);
+    free(s->key);
+    free(s);
+    return NULL;
+  }
+  for (k=0; k<n; k++) {
+    s->work_grids[k] = (struct grid *) (s->arena + k * GRID_SIZE(gr));
+  }
+  s->arena_levels = s->work_room = n;
+  s->want = 1;
+  return s;
+}
+
+
+/********************************************************************************
+*** Resets a solver for a new search, clearing its statistics.
+********************************************************************************/
+static void
+reset_solver(s)
+  struct solver *s;
+{
+  s->work_depth = 0;
+  s->failed = 0;
+  s->nodes = 0;
+  s->guesses = 0;
+  s->max_depth = 0;
+  s->dead_hits = 0;
+}
+
+
+/********************************************************************************
+*** Budgets are counted from the top level of each search, so that one puzzle of
+*** a batch can't keep a solver from the rest. The clock is only read every
+*** BUDGET_CLOCK nodes, which is well under a millisecond of searching.
+********************************************************************************/
+#define BUDGET_CLOCK 256
+
+static void
+start_budget(s)
+  struct solver *s;
+{
+  s->node_limit = s->nodes + s->budget.nodes;
+  if (s->budget.msecs > 0) {
+    clock_gettime(CLOCK_MONOTONIC, &s->deadline);
+    s->deadline.tv_sec += s->budget.msecs / 1000;
+    s->deadline.tv_nsec += (s->budget.msecs % 1000) * 1000000;
+    if (s->deadline.tv_nsec >= 1000000000) {
+      s->deadline.tv_sec++;
+      s->deadline.tv_nsec -= 1000000000;
+    }
+  }
+}
+
+
+/********************************************************************************
+*** Checks the search against its budget, and whether it has been cancelled,
+*** which also clears the cancel flag. Returns boolean over or not, and sets
+*** s->failed to say why.
+********************************************************************************/
+static int
+over_budget(s)
+  struct solver *s;
+{
+  struct timespec now;
+  if (__atomic_load_n(&s->cancel, __ATOMIC_RELAXED)
+      && __atomic_exchange_n(&s->cancel, 0, __ATOMIC_RELAXED)) {
+    s->failed = SUD_CANCELLED;
+    return 1;
+  }
+  if (((s->budget.nodes > 0) && (s->nodes > s->node_limit))
+      || ((s->budget.depth > 0) && (s->work_depth > s->budget.depth))) {
+    s->failed = SUD_BUDGET;
+    return 1;
+  }
+  if ((s->budget.msecs > 0) && (s->nodes % BUDGET_CLOCK == 0)) {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if ((now.tv_sec > s->deadline.tv_sec)
+        || ((now.tv_sec == s->deadline.tv_sec) && (now.tv_nsec >= s->deadline.tv_nsec))) {
+      s->failed = SUD_BUDGET;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+/********************************************************************************
+*** The table of dead ends. A grid state the search has proven to have no
+*** solution is remembered by a Zobrist hash of its solved cells: the exclusive
+*** or of a random key for each cell and its value. The rest of the state
+*** follows from those, because reducing a grid always ends at the same grid
+*** for the same solved cells, whatever the order they were solved in, but only
+*** if the search started from a grid of clues with every other cell open: a
+*** grid with values taken out of its open cells (as other_solution() searches)
+*** has states the hash can't tell apart from those of its clues alone, so the
+*** table is only sound for puzzles made purely of clues. Within one search no
+*** state comes round twice (the two sides of any guess differ in the cell
+*** guessed), but dead ends are dead whatever the puzzle was, so the table is
+*** kept from one search to the next. That pays when a solver is given one
+*** puzzle after another that differ in a clue or two, whose searches go
+*** through much the same states. The keys come from hashing the cell and value, worked out
+*** once when the table is made. It's a table of sets of DEAD_WAYS entries,
+*** each with the number of nodes it took to prove the dead end, and a new dead
+*** end takes the place of the cheapest in its set, so that what was costly to
+*** learn stays longest. Dead ends of fewer than DEAD_NODES nodes are cheaper to
+*** search again than to look up, and aren't kept, and nor is a grid with
+*** fewer than DEAD_OPEN cells left open looked up at all, since what's under
+*** it is seldom more than a few nodes.
+********************************************************************************/
+#define DEAD_WAYS 4
+#define DEAD_NODES 4
+#define DEAD_OPEN (2*MAX_VAL)
+
+struct dead_end {
+  unsigned long long hash;      /* 0 for none */
+  long nodes;                   /* nodes searched to prove it */
+};
+
+
+/********************************************************************************
+*** The Zobrist key of value v in cell i, as splitmix64 of them.
+********************************************************************************/
+static unsigned long long
+zobrist_key(i, v)
+  int i,v;
+{
+  unsigned long long z;
+  z = ((unsigned long long) i * (MAX_VAL + 1) + v + 1) * 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+
+/********************************************************************************
+*** The hash of the solved cells of a grid, never 0.
+********************************************************************************/
+static unsigned long long
+grid_hash(s, g)
+  struct solver *s;
+  struct grid *g;
+{
+  unsigned long long h;
+  int i;
+  h = 0;
+  for (i=0; i<g->gr->ncells; i++) {
+    if (g->cells[i].w[0] & SOLVED) {
+      h ^= s->zobrist[i * (MAX_VAL + 1) + get_value(&g->cells[i])];
+    }
+  }
+  return h ? h : 1;
+}
+
+
+/********************************************************************************
+*** Returns boolean whether the state with hash h is a known dead end.
+********************************************************************************/
+static int
+dead_end(s, h)
+  struct solver *s;
+  unsigned long long h;
+{
+  struct dead_end *d;
+  int k;
+  d = s->dead + (h % s->dead_sets) * DEAD_WAYS;
+  for (k=0; k<DEAD_WAYS; k++) {
+    if (d[k].hash == h) {
+      s->dead_hits++;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+/********************************************************************************
+*** Remembers the state with hash h as a dead end, which took so many nodes to
+*** prove, in place of the cheapest dead end of its set.
+********************************************************************************/
+static void
+add_dead_end(s, h, nodes)
+  struct solver *s;
+  unsigned long long h;
+  long nodes;
+{
+  struct dead_end *d;
+  int k,cheapest;
+  d = s->dead + (h % s->dead_sets) * DEAD_WAYS;
+  cheapest = 0;
+  for (k=0; k<DEAD_WAYS; k++) {
+    if (d[k].hash == 0) {
+      cheapest = k;
+      break;
+    }
+    if (d[k].nodes < d[cheapest].nodes) cheapest = k;
+  }
+  d[cheapest].hash = h;
+  d[cheapest].nodes = nodes;
+}
+
+
+/********************************************************************************
+*** The next random number of the solver's own sequence: xorshift64* on its seed.
+********************************************************************************/
+static unsigned long long
+random_next(s)
+  struct solver *s;
+{
+  if (s->seed == 0) s->seed = 0x9e3779b97f4a7c15ULL;
+  s->seed ^= s->seed >> 12;
+  s->seed ^= s->seed << 25;
+  s->seed ^= s->seed >> 27;
+  return s->seed * 0x2545f4914f6cdd1dULL;
+}
+
+
+/********************************************************************************
+*** Pointers to input and output grids are passed into the function.
+*** Returns boolean success or failure.
+*** Recursive process, creating local copies of the working grid
+*** until the parent call either succeeds (solves all cells) or fails.
+*** To count solutions, set s->want to how many to count up to: the search
+*** goes on past each solution until it has found that many (or all there are),
+*** counting them in s->found, and the first goes into the output grid. It
+*** succeeds if it found as many as it wanted. A solution the same as s->differ
+*** doesn't count, so setting it looks for a solution other than a known one,
+*** and s->each, if set, is called with every solution that does.
+********************************************************************************/
+static int
+try(s, ig, og)
+  struct solver *s;     /* working state of the search */
+  struct grid *ig;      /* the input grid to try solving */
+  struct grid *og;      /* the output grid that we copy into if we succeed */
+{
+  struct grid *wg;      /* a local working copy of the grid */
+  struct grid **levels;
+  int r,reductions;
+  int tc;               /* our working cell */
+  struct cell wc;       /* working cell value, for guesses */
+  int k;                /* guess iterator */
+  int j,first;          /* and where it starts */
+  int result;
+  unsigned long long h; /* the hash of the grid, for the table of dead ends */
+  long nodes,found;
+
+  if (s->work_depth == 0) {
+    if (!s->budget_kept) start_budget(s);
+    s->failed = 0;
+    s->found = 0;
+  }
+
+  /* take the working grid for this level of the search */
+  if (s->work_depth == s->work_room) {
+    levels = (struct grid **) realloc(s->work_grids, 2*(s->work_room + 8) * sizeof(struct grid *));
+    if (levels == NULL) {
+      s->failed = SUD_NO_MEMORY;
+      return 0;
+    }
+    s->work_grids = levels;
+    for (k=s->work_room; k<2*(s->work_room + 8); k++) {
+      s->work_grids[k] = NULL;
+    }
+    s->work_room = 2*(s->work_room + 8);
+  }
+  if (s->work_grids[s->work_depth] == NULL) {
+    s->work_grids[s->work_depth] = (struct grid *) malloc(GRID_SIZE(ig->gr));
+    if (s->work_grids[s->work_depth] == NULL) {
+      s->failed = SUD_NO_MEMORY;
+      return 0;
+    }
+  }
+  wg = s->work_grids[s->work_depth++];
+  copy_grid(ig, wg);    /* copy the input grid into a local working grid */
+  s->nodes++;
+  if (s->work_depth > s->max_depth) s->max_depth = s->work_depth;
+  if (over_budget(s)) {
+    s->work_depth--;
+    return 0;
+  }
+
+  /* the first thing to do is to reduce the possible cell values */
+  /* in unsolved cells of the working grid, based on the input clues */
+  reductions = 0;
+  result = 0;
+  do {
+    r = reduce_grid(wg);
+    /* test for failure */
+    if (r == -1) {
+      s->work_depth--;
+      return 0;
+    }
+    reductions = reductions + r;
+  }
+  while (r>0);    /* rinse and repeat until we can reduce the grid no further */
+
+  /* check if the sudoku game is solved (all cells solved) */
+  /* and if we have solved it, copy the working grid into the output grid */
+  /* and return success */ 
+  if (wg->solved_counter == wg->gr->ncells) {
+    /* a solution we've been told to look past doesn't count */
+    if ((s->differ != NULL)
+        && (memcmp(wg->cells, s->differ->cells, wg->gr->ncells * sizeof(struct cell)) == 0)) {
+      s->work_depth--;
+      return 0;
+    }
+    if (s->found++ == 0) copy_grid(wg, og);    /* copy the working grid into the output grid */
+    if (s->each != NULL) (*s->each)(s->each_arg, wg);
+    s->work_depth--;
+    return s->found >= s->want;
+  }
+
+  /* give up on a grid already proven to lead nowhere */
+  h = 0;
+  nodes = s->nodes;
+  found = s->found;
+  if ((s->dead != NULL) && (s->differ == NULL) && (wg->gr->ncells - wg->solved_counter >= DEAD_OPEN)) {
+    h = grid_hash(s, wg);
+    if (dead_end(s, h)) {
+      s->work_depth--;
+      return 0;
+    }
+  }
+
+  /* Ok, so we have a grid that is not solved, we're going to have to guess the */
+  /* next move. Find a cell with not many options (simple optimisation). */
+  choose_target_cell(wg, &tc);
+
+  /* Now loop through those possible options, updating the value of the target cell */
+  /* each time. Call try() on each potential version of the working grid. */
+  wc = wg->cells[tc];
+
+  /* pretend we have solved this cell */
+  wg->solved_counter = wg->solved_counter + 1;
+
+  /* and guess each of the possible solutions for it in turn, from a random one
+  ** when making a random grid */
+  first = s->shuffle ? random_next(s) % MAX_VAL : 0;
+  for (j=0; j<MAX_VAL; j++) {
+    k = (first + j) % MAX_VAL + 1;
+    if (wc.w[WORD(k)] & BIT(k)) {
+      /* possible: we modify the grid */
+      set_value(&wg->cells[tc], k);
+      s->guesses++;
+      /* now call try with the modified grid */
+      if (try(s, wg, og)) {
+        /* yipee, it worked, we got there! */
+        result = 1;
+        break;
+      }
+      /* out of memory, out of budget or cancelled: give up altogether */
+      if (s->failed) break;
+    }
+  }
+  if ((h != 0) && !s->failed && (s->found == found) && (s->nodes - nodes >= DEAD_NODES)) {
+    add_dead_end(s, h, s->nodes - nodes);
+  }
+
+  /* meh, if none of the options worked, return failure */
+  s->work_depth--;
+  return result;
+}
+
+
+/********************************************************************************
+*** The solution cache. Puzzles that come round again, whether the same or the
+*** same but for the symmetries of the canonical form, are looked up rather than
+*** solved again: the cache is keyed by the canonical form of the clues and
+*** holds the solution of the canonical form (or that there is none), which the
+*** transform from the puzzle to its canonical form turns back into a solution
+*** of the puzzle. It's split into CACHE_SHARDS shards, each with its own lock,
+*** hash table and list of entries from the most recently used to the least, so
+*** that threads sharing a cache seldom wait for each other, and when a shard
+*** is full its least recently used entry makes way. Values are kept a byte
+*** each, so the cache is for grids of up to 255 values.
+*** Canonising a classic puzzle costs about as much as searching 60 nodes, so a
+*** puzzle only goes to the cache once it has taken more than CACHE_NODES nodes
+*** to solve: easy puzzles are never slowed down, and hard ones are searched
+*** again from the start on a miss, which only repeats the first CACHE_NODES,
+*** and counts them against the puzzle's budget.
+*** With more than one solution, the solution the cache gives back is the one
+*** found for whichever form of the puzzle was solved first.
+********************************************************************************/
+#define CACHE_SHARDS 16
+#define CACHE_NODES 100
+/* entries are a whole number of the alignment of struct entry apart, so that
+** every one of them is aligned */
+#define ENTRY_ALIGN offsetof(struct { char c; struct entry e; }, e)
+#define ENTRY_SIZE ((sizeof(struct entry) + 2*ROWS*COLS - 1 + ENTRY_ALIGN - 1) / ENTRY_ALIGN * ENTRY_ALIGN)
+
+struct entry {
+  int next;             /* the next entry in the same bucket, or -1 */
+  int newer,older;      /* neighbours in the shard's list, or -1 */
+  unsigned long hash;
+  char solved;          /* set if there is a solution, clear if none */
+  unsigned char cells[1];  /* the clues of the canonical form, then its solution */
+};
+
+struct shard {
+  pthread_mutex_t lock;
+  char *entries;        /* room for room entries of ENTRY_SIZE, */
+  int room;
+  int used;             /* of which this many are in use */
+  int *buckets;         /* the first entry in each bucket, or -1 */
+  int nbuckets;
+  int newest,oldest;    /* the ends of the list */
+  long hits,misses;
+};
+
+struct sud_cache {
+  struct shard shards[CACHE_SHARDS];
+};
+
+#define ENTRY(sh, e) ((struct entry *) ((sh)->entries + (long) (e) * ENTRY_SIZE))
+
+
+void
+sud_cache_free(ca)
+  struct sud_cache *ca;
+{
+  int k;
+  if (ca == NULL) {
+    return;
+  }
+  for (k=0; k<CACHE_SHARDS; k++) {
+    pthread_mutex_destroy(&ca->shards[k].lock);
+    free(ca->shards[k].entries);
+    free(ca->shards[k].buckets);
+  }
+  free(ca);
+}
+
+
+struct sud_cache *
+sud_cache_new(entries)
+  long entries;
+{
+  struct sud_cache *ca;
+  struct shard *sh;
+  int k,b;
+
+  if ((ca = (struct sud_cache *) calloc(1, sizeof(struct sud_cache))) == NULL) {
+    return NULL;
+  }
+  for (k=0; k<CACHE_SHARDS; k++) {
+    sh = &ca->shards[k];
+    pthread_mutex_init(&sh->lock, NULL);
+    sh->room = (entries + CACHE_SHARDS - 1) / CACHE_SHARDS;
+    if (sh->room < 1) sh->room = 1;
+    sh->nbuckets = 2*sh->room;
+    sh->entries = (char *) malloc(sh->room * ENTRY_SIZE);
+    sh->buckets = (int *) malloc(sh->nbuckets * sizeof(int));
+    if ((sh->entries == NULL) || (sh->buckets == NULL)) {
+      sud_cache_free(ca);
+      return NULL;
+    }
+    for (b=0; b<sh->nbuckets; b++) {
+      sh->buckets[b] = -1;
+    }
+    sh->newest = sh->oldest = -1;
+  }
+  return ca;
+}
+
+
+/********************************************************************************
+*** Takes entry e out of the list of its shard, and puts it back at the front.
+********************************************************************************/
+static void
+unlink_entry(sh, e)
+  struct shard *sh;
+  int e;
+{
+  struct entry *p;
+  p = ENTRY(sh, e);
+  if (p->newer >= 0) ENTRY(sh, p->newer)->older = p->older;
+  else sh->newest = p->older;
+  if (p->older >= 0) ENTRY(sh, p->older)->newer = p->newer;
+  else sh->oldest = p->newer;
+}
+
+static void
+push_entry(sh, e)
+  struct shard *sh;
+  int e;
+{
+  struct entry *p;
+  p = ENTRY(sh, e);
+  p->newer = -1;
+  p->older = sh->newest;
+  if (sh->newest >= 0) ENTRY(sh, sh->newest)->newer = e;
+  else sh->oldest = e;
+  sh->newest = e;
+}
+
+
+/* FNV-1a, over the values of the canonical clues */
+static unsigned long
+cache_hash(key)
+  unsigned char *key;
+{
+  unsigned long h;
+  int i;
+  h = 14695981039346656037UL;
+  for (i=0; i<ROWS*COLS; i++) {
+    h = (h ^ key[i]) * 1099511628211UL;
+  }
+  /* the store takes a hash of 0 for an empty slot */
+  return h ? h : 1;
+}
+
+
+/********************************************************************************
+*** Looks up the canonical clues key, and copies the solution into sol if there
+*** is one. Returns 1 if there's a solution, 0 if there's none and -1 if the
+*** cache doesn't know.
+********************************************************************************/
+static int
+cache_find(ca, key, hash, sol)
+  struct sud_cache *ca;
+  unsigned char *key;
+  unsigned long hash;
+  unsigned char *sol;
+{
+  struct shard *sh;
+  struct entry *p;
+  int e,found;
+
+  sh = &ca->shards[hash % CACHE_SHARDS];
+  found = -1;
+  pthread_mutex_lock(&sh->lock);
+  for (e=sh->buckets[hash / CACHE_SHARDS % sh->nbuckets]; e>=0; e=p->next) {
+    p = ENTRY(sh, e);
+    if ((p->hash == hash) && (memcmp(p->cells, key, ROWS*COLS) == 0)) {
+      if ((found = p->solved)) memcpy(sol, p->cells + ROWS*COLS, ROWS*COLS);
+      unlink_entry(sh, e);
+      push_entry(sh, e);
+      break;
+    }
+  }
+  if (found < 0) sh->misses++;
+  else sh->hits++;
+  pthread_mutex_unlock(&sh->lock);
+  return found;
+}
+
+
+/********************************************************************************
+*** Stores the solution sol of the canonical clues key, or that there's none if
+*** sol is NULL, making way for it if the shard is full.
+********************************************************************************/
+static int
+cache_store(ca, key, hash, sol)
+  struct sud_cache *ca;
+  unsigned char *key;
+  unsigned long hash;
+  unsigned char *sol;
+{
+  struct shard *sh;
+  struct entry *p;
+  int e,*link;
+
+  sh = &ca->shards[hash % CACHE_SHARDS];
+  pthread_mutex_lock(&sh->lock);
+  for (e=sh->buckets[hash / CACHE_SHARDS % sh->nbuckets]; e>=0; e=p->next) {
+    p = ENTRY(sh, e);
+    if ((p->hash == hash) && (memcmp(p->cells, key, ROWS*COLS) == 0)) break;
+  }
+  if (e >= 0) {
+    /* another thread got there first */
+    pthread_mutex_unlock(&sh->lock);
+    return 0;
+  }
+  if (sh->used < sh->room) {
+    e = sh->used++;
+  }
+  else {
+    /* the least recently used entry makes way */
+    e = sh->oldest;
+    unlink_entry(sh, e);
+    p = ENTRY(sh, e);
+    for (link=&sh->buckets[p->hash / CACHE_SHARDS % sh->nbuckets]; *link!=e; link=&ENTRY(sh, *link)->next);
+    *link = p->next;
+  }
+  p = ENTRY(sh, e);
+  p->hash = hash;
+  p->solved = sol != NULL;
+  memcpy(p->cells, key, ROWS*COLS);
+  if (sol != NULL) memcpy(p->cells + ROWS*COLS, sol, ROWS*COLS);
+  link = &sh->buckets[hash / CACHE_SHARDS % sh->nbuckets];
+  p->next = *link;
+  *link = e;
+  push_entry(sh, e);
+  pthread_mutex_unlock(&sh->lock);
+  return 1;
+}
+
+
+/* the values of a grid of the classic rules, a byte each */
+static void
+grid_values(g, v)
+  struct grid *g;
+  unsigned char *v;
+{
+  int i;
+  for (i=0; i<ROWS*COLS; i++) {
+    v[i] = get_value(&g->cells[i]);
+  }
+}
+
+static void
+values_grid(v, g)
+  unsigned char *v;
+  struct grid *g;
+{
+  int i;
+  grid_zero(g, g->gr);
+  for (i=0; i<ROWS*COLS; i++) {
+    if (v[i] == 0) continue;
+    set_value(&g->cells[i], v[i]);
+    g->solved_counter++;
+  }
+}
+
+
+/********************************************************************************
+*** The solution store keeps what the cache learns from one run to the next. A
+*** store is a file written by sud -a and mapped read only by whoever uses it,
+*** so that a new process has everything solved before from the moment it
+*** starts. It's the header: "SUDS", a version byte, R_ROWS and R_COLS as a
+*** byte each, a spare byte, the number of slots as 8 bytes, least significant
+*** first, and the number in use as 8 more, padded to STORE_HEADER; then a hash
+*** table of that many slots with open addressing. A slot is the hash of the
+*** canonical clues as 8 bytes (0 for an empty slot), a byte set if there's a
+*** solution, and the values of the canonical clues and solution a byte each,
+*** as in the cache. A table is never more than half full, so looking up a
+*** puzzle seldom takes more than a slot or two, and nothing in it ever moves:
+*** it's only ever written whole, beside the old one.
+********************************************************************************/
+#define STORE_MAGIC "SUDS"
+#define STORE_VERSION 1
+#define STORE_HEADER 32
+#define STORE_SLOT (9 + 2*ROWS*COLS)
+
+/********************************************************************************
+*** Checks that the n characters at p are a store for the size of grid we solve.
+*** Returns the number of slots, or 0 if it's not.
+********************************************************************************/
+static long
+check_store(p, n)
+  unsigned char *p;
+  long n;
+{
+  long slots;
+  if ((n < STORE_HEADER) || (memcmp(p, STORE_MAGIC, 4) != 0) || (p[4] != STORE_VERSION)
+      || (p[5] != R_ROWS) || (p[6] != R_COLS)) {
+    return 0;
+  }
+  slots = get_number(p + 8, 8);
+  return (slots > 0) && (n == STORE_HEADER + slots * STORE_SLOT) ? slots : 0;
+}
+
+
+#ifdef SUD_PROGRAM
+/********************************************************************************
+*** Writes the header of a store of so many slots into p.
+********************************************************************************/
+static void
+store_header(p, slots, used)
+  unsigned char *p;
+  long slots,used;
+{
+  memset(p, 0, STORE_HEADER);
+  memcpy(p, STORE_MAGIC, 4);
+  p[4] = STORE_VERSION;
+  p[5] = R_ROWS;
+  p[6] = R_COLS;
+  put_number(p + 8, slots, 8);
+  put_number(p + 16, used, 8);
+}
+#endif
+
+
+/********************************************************************************
+*** Finds the slot for the canonical clues key in a table of slots: the one
+*** holding them, or the empty one where they would go. The table comes from a
+*** file, so it may have no empty slot: returns NULL if it's been all the way
+*** round without finding one.
+********************************************************************************/
+static unsigned char *
+store_slot(table, slots, key, hash)
+  unsigned char *table;
+  long slots;
+  unsigned char *key;
+  unsigned long hash;
+{
+  unsigned char *p;
+  unsigned long h;
+  long k,n;
+  for (n=0, k=hash%slots; n<slots; n++, k=(k+1)%slots) {
+    p = table + k * STORE_SLOT;
+    if ((h = (unsigned long) get_number(p, 8)) == 0) {
+      return p;
+    }
+    if ((h == hash) && (memcmp(p + 9, key, ROWS*COLS) == 0)) {
+      return p;
+    }
+  }
+  return NULL;
+}
+
+
+/********************************************************************************
+*** Looks up the canonical clues key in the store, as cache_find() does.
+********************************************************************************/
+static int
+store_find(s, key, hash, sol)
+  struct solver *s;
+  unsigned char *key;
+  unsigned long hash;
+  unsigned char *sol;
+{
+  unsigned char *p;
+  p = store_slot(s->store, s->store_slots, key, hash);
+  if ((p == NULL) || (get_number(p, 8) == 0)) {
+    return -1;
+  }
+  if (p[8]) memcpy(sol, p + 9 + ROWS*COLS, ROWS*COLS);
+  return p[8];
+}
+
+
+/********************************************************************************
+*** Solves a puzzle as try() does, but through the solver's cache and store if
+*** it has them. Sets s->keyed if s->key and s->sol are left holding the puzzle
+*** and its solution in canonical form, for sud -a to keep.
+*** Returns boolean success or failure, with s->failed set as try() sets it.
+********************************************************************************/
+static int
+solve_grid(s, ig, og)
+  struct solver *s;
+  struct grid *ig;      /* the puzzle */
+  struct grid *og;      /* where its solution goes */
+{
+  struct sud_budget budget;
+  struct transform t;
+  unsigned long hash;
+  long start,limit;
+  int solved,found;
+
+  s->keyed = 0;
+  if (((s->cache == NULL) && (s->store == NULL)) || (s->canon == NULL)) {
+    return try(s, ig, og);
+  }
+
+  /* easy puzzles are done before they would be canonised, on the same budget
+  ** as the search after them */
+  budget = s->budget;
+  start_budget(s);
+  limit = s->node_limit;
+  if ((budget.nodes == 0) || (budget.nodes > CACHE_NODES)) s->budget.nodes = CACHE_NODES;
+  start = s->nodes;
+  s->node_limit = start + s->budget.nodes;
+  s->budget_kept = 1;
+  solved = try(s, ig, og);
+  s->budget_kept = 0;
+  s->budget = budget;
+  s->node_limit = limit;
+  if (solved || (s->failed != SUD_BUDGET) || (s->nodes - start <= CACHE_NODES)
+      || ((budget.nodes > 0) && (budget.nodes <= CACHE_NODES))) {
+    return solved;
+  }
+  s->failed = 0;
+
+  canonical_form(s->canon, ig, &t);
+  transform_grid(&t, ig, s->canon_grid, 0);
+  grid_values(s->canon_grid, s->key);
+  hash = cache_hash(s->key);
+  found = s->cache != NULL ? cache_find(s->cache, s->key, hash, s->sol) : -1;
+  if ((found < 0) && (s->store != NULL) && ((found = store_find(s, s->key, hash, s->sol)) >= 0)
+      && (s->cache != NULL)) {
+    cache_store(s->cache, s->key, hash, found ? s->sol : (unsigned char *) NULL);
+  }
+  if (found >= 0) {
+    if (found) {
+      values_grid(s->sol, s->canon_grid);
+      transform_grid(&t, s->canon_grid, og, 1);
+    }
+    s->keyed = 1;
+    return found;
+  }
+
+  s->budget_kept = 1;
+  solved = try(s, ig, og);
+  s->budget_kept = 0;
+  if (solved) {
+    transform_grid(&t, og, s->canon_grid, 0);
+    grid_values(s->canon_grid, s->sol);
+  }
+  if ((solved || !s->failed) && (s->cache != NULL)) {
+    cache_store(s->cache, s->key, hash, solved ? s->sol : (unsigned char *) NULL);
+  }
+  s->keyed = solved || !s->failed;
+  return solved;
+}
+
+
+/********************************************************************************
+*** Counts the solutions of a puzzle, up to limit of them (or all of them if
+*** limit is 0), with the first in og. Bypasses the cache, which knows only one
+*** solution of each puzzle. Returns the count, or -1 if the search gave up,
+*** with s->failed set as try() sets it.
+********************************************************************************/
+static long
+count_grid(s, ig, og, limit)
+  struct solver *s;
+  struct grid *ig;
+  struct grid *og;
+  long limit;
+{
+  s->want = limit > 0 ? limit : LONG_MAX;
+  try(s, ig, og);
+  s->want = 1;
+  return s->failed ? -1 : s->found;
+}
+
+
+/********************************************************************************
+*** Gives the solver a table of dead ends with room for at least entries of them,
+*** or none if entries is 0. Returns boolean success or failure.
+********************************************************************************/
+static int
+dead_ends(s, gr, entries)
+  struct solver *s;
+  struct graph *gr;
+  long entries;
+{
+  struct dead_end *d;
+  long sets;
+  int i,v;
+  sets = (entries + DEAD_WAYS - 1) / DEAD_WAYS;
+  d = NULL;
+  if ((sets > 0) && ((d = (struct dead_end *) calloc(sets * DEAD_WAYS, sizeof(struct dead_end))) == NULL)) {
+    return 0;
+  }
+  if ((sets > 0) && (s->zobrist == NULL)) {
+    s->zobrist = (unsigned long long *) malloc(gr->ncells * (MAX_VAL + 1) * sizeof(unsigned long long));
+    if (s->zobrist == NULL) {
+      free(d);
+      return 0;
+    }
+    for (i=0; i<gr->ncells; i++) {
+      for (v=0; v<=MAX_VAL; v++) {
+        s->zobrist[i * (MAX_VAL + 1) + v] = zobrist_key(i, v);
+      }
+    }
+  }
+  free(s->dead);
+  s->dead = d;
+  s->dead_sets = sets;
+  return 1;
+}
+
+
+/* sets of cells, a bit for each in words of 64 */
+#define HAS(set, i) ((set)[(i)/64] & (1ULL << ((i)%64)))
+#define ADD(set, i) ((set)[(i)/64] |= 1ULL << ((i)%64))
+#define DROP(set, i) ((set)[(i)/64] &= ~(1ULL << ((i)%64)))
+
+#ifdef SUD_PROGRAM
+/********************************************************************************
+*** Generating puzzles. A random full grid comes from sample_grid(), and a
+*** puzzle from taking its clues away in a random order, keeping each one that
+*** can't go without the puzzle getting a second solution. Checking that is a
+*** count of the solutions up to 2, done as a search for a solution other than
+*** the full grid, which is all a second one could be, and it seldom costs more
+*** than a few dozen nodes, as the puzzle is full of clues until the end. Clues
+*** go in sets that keep the puzzle symmetric, a cell and its images under the
+*** symmetry, so a symmetric puzzle takes no more checks than any other. The
+*** random numbers come from a seed in the solver, so each thread has its own
+*** and a seed always gives the same puzzles.
+********************************************************************************/
+#define SYM_NONE 0
+#define SYM_ROTATE 1           /* half turn */
+#define SYM_MIRROR 2           /* left to right */
+#define SYM_DIAGONAL 3         /* about the main diagonal, for square grids */
+
+/********************************************************************************
+*** Fills og with a random full grid of the graph of ig, which it clears: a
+*** search of the empty grid that tries the values of each guess starting from a
+*** random one. The boxes down the diagonal of a classic grid share no unit, so
+*** they're filled with random values first, which leaves the search much less
+*** to do. This is cheap, but some grids come far more often than others. A
+*** search that starts badly can run for minutes, as on some jigsaw layouts, so
+*** it gives up after RANDOM_NODES nodes and starts again with new random
+*** values and twice the nodes; a classic grid is nearly always done in the first.
+*** Returns boolean success or failure.
+********************************************************************************/
+#define RANDOM_NODES 1000
+
+static int
+random_grid(s, ig, og)
+  struct solver *s;
+  struct grid *ig;
+  struct grid *og;
+{
+  struct sud_budget budget;
+  int values[MAX_VAL];
+  int b,i,j,k,solved;
+
+  budget = s->budget;
+  s->budget.nodes = RANDOM_NODES;
+  s->shuffle = 1;
+  do {
+    grid_zero(ig, ig->gr);
+    for (b=0; (b<BANDS) && (b<STACKS) && classic_rules(ig->gr); b++) {
+      for (k=0; k<MAX_VAL; k++) {
+        j = random_next(s) % (k + 1);
+        values[k] = values[j];
+        values[j] = k + 1;
+      }
+      for (k=0; k<MAX_VAL; k++) {
+        i = (b*R_ROWS + k/R_COLS) * COLS + b*R_COLS + k%R_COLS;
+        set_value(&ig->cells[i], values[k]);
+        ig->solved_counter++;
+      }
+    }
+    solved = try(s, ig, og);
+    if (!solved && !s->failed && (ig->solved_counter > ig->gr->nholes)) {
+      /* the diagonal doesn't always leave a solution on other sizes of grid */
+      grid_zero(ig, ig->gr);
+      solved = try(s, ig, og);
+    }
+    s->budget.nodes *= 2;
+  } while (!solved && (s->failed == SUD_BUDGET));
+  s->shuffle = 0;
+  s->budget = budget;
+  return solved;
+}
+
+
+/********************************************************************************
+*** Nearly uniform full grids come from a random walk. A step picks a cell and
+*** another value, and swaps the two values in every cell of the chain holding
+*** them that the cell is part of: the cells holding either value that are tied
+*** to it through units, so every unit has both or neither, and the grid stays
+*** full. On a classic grid a step can also pick a cell and another row of its
+*** band (or column of its stack), and swap the values of the two rows in the
+*** columns of the chain through the cell: the columns where the values moved
+*** from one row to the other are the ones moved back. From the grid after a
+*** step the same chain can be picked with the same chance, and swapped back,
+*** so the walk comes to every grid it can reach as often as any other, and
+*** each step can only take it closer to that. Value chains alone can't reach
+*** every grid from every other, as a count of the patterns in 6x6 grids shows,
+*** but with the row and column chains the walk comes out uniform on that
+*** count. A classic grid is also rearranged by a random transform, of the kind
+*** that canonical forms undo, which keeps the chances the same in the same way.
+*** Killer cages would need their sums kept, so a graph with cages has only the
+*** search of random_grid(). Each grid is a walk of its own from a new grid of
+*** random_grid(), so that no two grids share any of their walk: carrying one
+*** walk on from grid to grid leaves grids a few steps apart alike, which the
+*** random transform hides but doesn't undo. On 6x6 grids the count settles
+*** within 36 steps, a step for each cell, which is WALK_STEPS; test_walk.c
+*** checks the count against every 6x6 grid there is. A step costs well under a
+*** microsecond, so the walk is still less work than the search it starts from.
+********************************************************************************/
+#define WALK_STEPS(gr) ((gr)->ncells - (gr)->nholes)
+
+/* swaps values a and b along the chain through cell i of the full grid g */
+static void
+swap_chain(s, g, i, a, b)
+  struct solver *s;
+  struct grid *g;
+  int i,a,b;
+{
+  struct graph *gr;
+  int *stack;
+  int n,j,k,v;
+
+  gr = g->gr;
+  stack = s->order;
+  set_value(&g->cells[i], b);
+  stack[0] = i;
+  /* a cell that has just changed clashes with the peers that still hold its
+  ** new value, which are the next cells of the chain */
+  for (n=1; n>0; ) {
+    i = stack[--n];
+    v = get_value(&g->cells[i]);
+    for (k=gr->peer_start[i]; k<gr->peer_start[i+1]; k++) {
+      j = gr->peers[k];
+      if (get_value(&g->cells[j]) == v) {
+        set_value(&g->cells[j], v == a ? b : a);
+        stack[n++] = j;
+      }
+    }
+  }
+}
+
+
+/* swaps the values of the lines of cells step apart starting at cells p and q
+** (two rows of a band, or two columns of a stack) at position k, and then at
+** every other position the chain through it comes to */
+static void
+swap_lines(g, p, q, step, k)
+  struct grid *g;
+  int p,q,step,k;
+{
+  struct cell c;
+  int first,v,j;
+
+  first = get_value(&g->cells[p + k*step]);
+  for (;;) {
+    c = g->cells[p + k*step];
+    g->cells[p + k*step] = g->cells[q + k*step];
+    g->cells[q + k*step] = c;
+    /* the value moved into line p is there twice now, unless it closes the chain */
+    if ((v = get_value(&g->cells[p + k*step])) == first) break;
+    for (j=0; (j == k) || (get_value(&g->cells[p + j*step]) != v); j++);
+    k = j;
+  }
+}
+
+
+/* a random permutation of 0 .. n-1 into p */
+static void
+random_order(s, p, n)
+  struct solver *s;
+  int *p;
+  int n;
+{
+  int j,k;
+  for (k=0; k<n; k++) {
+    j = random_next(s) % (k + 1);
+    p[k] = p[j];
+    p[j] = k;
+  }
+}
+
+
+/* a random transform of a classic grid */
+static void
+random_transform(s, t)
+  struct solver *s;
+  struct transform *t;
+{
+  int band[BANDS],stack[STACKS],within[MAX_VAL];
+  int b,k;
+
+  t->transpose = (R_ROWS == R_COLS) && (random_next(s) & 1);
+  random_order(s, band, BANDS);
+  for (b=0; b<BANDS; b++) {
+    random_order(s, within, R_ROWS);
+    for (k=0; k<R_ROWS; k++) {
+      t->row[b*R_ROWS + k] = band[b]*R_ROWS + within[k];
+    }
+  }
+  random_order(s, stack, STACKS);
+  for (b=0; b<STACKS; b++) {
+    random_order(s, within, R_COLS);
+    for (k=0; k<R_COLS; k++) {
+      t->col[b*R_COLS + k] = stack[b]*R_COLS + within[k];
+    }
+  }
+  random_order(s, within, MAX_VAL);
+  t->map[0] = 0;
+  for (k=0; k<MAX_VAL; k++) {
+    t->map[k+1] = within[k] + 1;
+  }
+}
+
+
+/********************************************************************************
+*** Fills og with a random full grid, taking steps of the walk from a grid of
+*** random_grid(). With no steps it's just the grid of random_grid(). ig is a
+*** grid to work in.
+*** Returns boolean success or failure.
+********************************************************************************/
+static int
+sample_grid(s, ig, og, steps)
+  struct solver *s;
+  struct grid *ig;
+  struct grid *og;
+  long steps;
+{
+  struct graph *gr;
+  struct transform t;
+  int i,r,c,a,b,classic;
+
+  gr = og->gr;
+  if (!random_grid(s, ig, og)) {
+    return 0;
+  }
+  if (gr->ncages > 0) {
+    return 1;
+  }
+  classic = classic_rules(gr);
+  for (; steps>0; steps--) {
+    i = gr->line_cell[random_next(s) % (gr->ncells - gr->nholes)];
+    r = i / COLS;
+    c = i % COLS;
+    switch (classic ? random_next(s) % 3 : 0) {
+    case 0:
+      a = get_value(&og->cells[i]);
+      b = 1 + random_next(s) % (MAX_VAL - 1);
+      if (b >= a) b++;
+      swap_chain(s, og, i, a, b);
+      break;
+    case 1:
+      b = 1 + random_next(s) % (R_ROWS > 1 ? R_ROWS - 1 : 1);
+      b = r - r%R_ROWS + (r%R_ROWS + b) % R_ROWS;
+      swap_lines(og, r*COLS, b*COLS, 1, c);
+      break;
+    case 2:
+      b = 1 + random_next(s) % (R_COLS > 1 ? R_COLS - 1 : 1);
+      b = c - c%R_COLS + (c%R_COLS + b) % R_COLS;
+      swap_lines(og, c, b, COLS, r);
+    }
+  }
+  if (classic) {
+    random_transform(s, &t);
+    transform_grid(&t, og, ig, 0);
+    copy_grid(ig, og);
+  }
+  return 1;
+}
+
+
+/********************************************************************************
+*** The image of cell i under a symmetry, which may be a hole or i itself.
+********************************************************************************/
+static int
+mirror_cell(gr, sym, i)
+  struct graph *gr;
+  int sym,i;
+{
+  int r,c;
+  r = i / gr->cols;
+  c = i % gr->cols;
+  switch (sym) {
+  case SYM_ROTATE: return (gr->rows - 1 - r) * gr->cols + gr->cols - 1 - c;
+  case SYM_MIRROR: return r * gr->cols + gr->cols - 1 - c;
+  case SYM_DIAGONAL: return c * gr->cols + r;
+  }
+  return i;
+}
+
+
+/********************************************************************************
+*** Looks for a solution of the puzzle pg other than sg, knowing that any other
+*** solution has to differ from sg in cell i or j, the clues just taken away:
+*** one search with the value of sg ruled out of cell i, and one with it ruled
+*** out of j but i fixed as in sg. This is a count of the solutions up to 2
+*** that doesn't have to find the one already known. tg is a grid to work in.
+*** Returns 1 if there is one or a search went over its budget, as there may
+*** be, 0 if not and -1 if a search failed otherwise.
+********************************************************************************/
+static int
+other_solution(s, sg, pg, tg, i, j)
+  struct solver *s;
+  struct grid *sg,*pg,*tg;
+  int i,j;
+{
+  struct cell mask;
+  int k;
+
+  copy_grid(pg, tg);
+  for (k=0; k<CELL_WORDS; k++) {
+    mask.w[k] = sg->cells[i].w[k];
+  }
+  mask.w[0] &= ~(CELL_WORD)SOLVED;
+  for (k=0; k<CELL_WORDS; k++) {
+    tg->cells[i].w[k] &= ~mask.w[k];
+  }
+  if (try(s, tg, tg)) {
+    return 1;
+  }
+  if (s->failed) {
+    return s->failed == SUD_BUDGET ? 1 : -1;
+  }
+  if (j == i) {
+    return 0;
+  }
+
+  copy_grid(pg, tg);
+  tg->cells[i] = sg->cells[i];
+  tg->solved_counter++;
+  for (k=0; k<CELL_WORDS; k++) {
+    mask.w[k] = sg->cells[j].w[k];
+  }
+  mask.w[0] &= ~(CELL_WORD)SOLVED;
+  for (k=0; k<CELL_WORDS; k++) {
+    tg->cells[j].w[k] &= ~mask.w[k];
+  }
+  if (try(s, tg, tg)) {
+    return 1;
+  }
+  if (s->failed) {
+    return s->failed == SUD_BUDGET ? 1 : -1;
+  }
+  return 0;
+}
+
+
+/********************************************************************************
+*** Makes a puzzle in pg with the full grid sg as its only solution, with clues
+*** symmetric under sym, by taking clues away until there are no more than
+*** target of them or none can go. tg is a grid to work in. Each check has a
+*** budget of GEN_NODES nodes, which the easy checks of a classic grid never come
+*** near, but one check of a big layout such as samurai can run to millions;
+*** a clue whose check gives up stays, so the puzzle is still sound, if not
+*** always minimal.
+*** Returns the number of clues, or -1 if a count failed.
+********************************************************************************/
+#define GEN_NODES 10000
+
+static int
+make_puzzle(s, sg, pg, tg, sym, target)
+  struct solver *s;
+  struct grid *sg,*pg,*tg;
+  int sym;
+  int target;
+{
+  struct sud_budget budget;
+  struct graph *gr;
+  int *order;
+  int i,j,k,n,r,clues;
+
+  gr = sg->gr;
+  budget = s->budget;
+  s->budget.nodes = GEN_NODES;
+  order = s->order;
+  n = gr->ncells - gr->nholes;
+  for (k=0; k<n; k++) {
+    order[k] = gr->line_cell[k];
+  }
+  for (k=n-1; k>0; k--) {
+    j = random_next(s) % (k + 1);
+    i = order[k];
+    order[k] = order[j];
+    order[j] = i;
+  }
+
+  copy_grid(sg, pg);
+  clues = n;
+  for (k=0; (k<n) && (clues>target); k++) {
+    i = order[k];
+    j = mirror_cell(gr, sym, i);
+    if (!(pg->cells[i].w[0] & SOLVED) || gr->hole[j]) continue;
+    open_cell(&pg->cells[i]);
+    pg->solved_counter--;
+    if (j != i) {
+      open_cell(&pg->cells[j]);
+      pg->solved_counter--;
+    }
+    if ((r = other_solution(s, sg, pg, tg, i, j)) < 0) {
+      s->budget = budget;
+      return -1;
+    }
+    if (r == 0) {
+      clues -= j != i ? 2 : 1;
+      continue;
+    }
+    /* the clues have to stay */
+    pg->cells[i] = sg->cells[i];
+    pg->cells[j] = sg->cells[j];
+    pg->solved_counter += j != i ? 2 : 1;
+  }
+  s->budget = budget;
+  return clues;
+}
+
+
+/********************************************************************************
+*** Minimal puzzles of a solution grid. An unavoidable set is a set of cells of
+*** the grid whose values could be arranged another way and still fit the rest
+*** of it, so every puzzle with the grid as its only solution has a clue in
+*** every unavoidable set. A hunt picks clues to hit every unavoidable set it
+*** knows, always branching on the cells of the set with fewest cells left to
+*** choose from, and after each branch rules that cell out of the branches that
+*** follow, so no set of clues is tried twice. It gives up on a branch as soon
+*** as it has more sets that share no cell left than it has clues left to hit
+*** them with. Once every known set is hit the clues are checked by a search
+*** for another solution, and if there is one, the cells where it differs make
+*** a new unavoidable set to branch on. Sets are cut down to a minimal set before
+*** they're kept, since a small set prunes far more than a big one. The first
+*** sets come from every way of rearranging the cells holding each set of two
+*** or three values (up to HUNT_VALUES), where most of the small sets are, and
+*** then from searching the grid with random cells opened.
+*** A hunt looks for puzzles of exactly target clues. Every puzzle it finds is
+*** minimal: it's checked that no clue can go. A branch whose clues already
+*** make a puzzle of fewer clues stops there, so hunting with targets from low
+*** to high finds each minimal puzzle once, the lowest clue counts first.
+*** The branches a hunt comes to at a given depth can be handed out as tasks,
+*** for other hunts of the same grid to carry on with on other threads.
+********************************************************************************/
+#define HUNT_TRIES 64          /* searches of random cells for the first unavoidable sets */
+#define HUNT_VALUES 3          /* most values to rearrange for them, */
+#define HUNT_ALTS 64           /* and most rearrangements of each set of values */
+#define HUNT_WORDS(gr) (((gr)->ncells + 63) / 64)
+
+struct hunt {
+  struct graph *gr;
+  struct solver *s;
+  struct grid *sg;              /* the solution grid */
+  struct grid *pg,*tg;          /* grids to work in */
+  int words;                    /* words in a set of cells */
+  unsigned long long *sets;     /* the unavoidable sets, smallest first, */
+  int *size;                    /* their sizes, */
+  int nsets,room;               /* and how many there are and room for */
+  unsigned long long *clues;    /* the clues of the branch, */
+  unsigned long long *dead;     /* and the cells ruled out of it */
+  unsigned long long *spare;    /* a set to work in, */
+  unsigned long long *diff;     /* where another solution differs, */
+  unsigned long long *branch;   /* and the cells to branch on at each depth */
+  int target;                   /* clues in the puzzles wanted */
+  int split;                    /* the depth to hand out tasks at, or -1 */
+  unsigned long long *alts;     /* the cells where each solution found differs, */
+  int nalts;                    /* and how many */
+  unsigned long long *tasks;    /* the clues and dead cells of each task */
+  long ntasks,task_room;
+  void (*found)();              /* called with each puzzle as (arg, pg) */
+  char *arg;
+  int failed;                   /* set if a search gave up */
+};
+
+
+static void
+free_hunt(h)
+  struct hunt *h;
+{
+  if (h != NULL) {
+    free_solver(h->s);
+    free(h->pg);
+    free(h->tg);
+    free(h->sets);
+    free(h->size);
+    free(h->clues);
+    free(h->tasks);
+    free(h->alts);
+    free(h);
+  }
+}
+
+
+/********************************************************************************
+*** Makes a hunt for the minimal puzzles of a graph, calling found(arg, pg) with
+*** each. Returns NULL if there's no memory.
+********************************************************************************/
+static struct hunt *
+new_hunt(gr, found, arg)
+  struct graph *gr;
+  void (*found)();
+  char *arg;
+{
+  struct hunt *h;
+  if ((h = (struct hunt *) calloc(1, sizeof(struct hunt))) == NULL) {
+    return NULL;
+  }
+  h->gr = gr;
+  h->words = HUNT_WORDS(gr);
+  h->found = found;
+  h->arg = arg;
+  h->s = new_solver(gr);
+  h->pg = new_grid(gr);
+  h->tg = new_grid(gr);
+  h->split = -1;
+  h->clues = (unsigned long long *) calloc((gr->ncells + 5) * h->words, sizeof(unsigned long long));
+  if ((h->s == NULL) || (h->pg == NULL) || (h->tg == NULL) || (h->clues == NULL)) {
+    free_hunt(h);
+    return NULL;
+  }
+  h->dead = h->clues + h->words;
+  h->spare = h->dead + h->words;
+  h->diff = h->spare + h->words;
+  h->branch = h->diff + h->words;
+  h->alts = (unsigned long long *) malloc(HUNT_ALTS * h->words * sizeof(unsigned long long));
+  if (h->alts == NULL) {
+    free_hunt(h);
+    return NULL;
+  }
+  return h;
+}
+
+
+/********************************************************************************
+*** Fills pg with the values of the solution grid in the cells of set.
+********************************************************************************/
+static void
+set_puzzle(h, set)
+  struct hunt *h;
+  unsigned long long *set;
+{
+  int i;
+  grid_zero(h->pg, h->gr);
+  for (i=0; i<h->gr->ncells; i++) {
+    if (HAS(set, i) && !h->gr->hole[i]) {
+      h->pg->cells[i] = h->sg->cells[i];
+      h->pg->solved_counter++;
+    }
+  }
+}
+
+
+/********************************************************************************
+*** Looks for a solution of pg other than the solution grid, and if there is one
+*** sets diff to the cells where it differs.
+*** Returns 1 if there is one, 0 if not and -1 if the search gave up.
+********************************************************************************/
+static int
+other_grid(h, diff)
+  struct hunt *h;
+  unsigned long long *diff;
+{
+  int i,found;
+  reset_solver(h->s);
+  h->s->differ = h->sg;
+  found = try(h->s, h->pg, h->tg);
+  h->s->differ = NULL;
+  if (h->s->failed) {
+    h->failed = 1;
+    return -1;
+  }
+  if (found) {
+    memset(diff, 0, h->words * sizeof(unsigned long long));
+    for (i=0; i<h->gr->ncells; i++) {
+      if (memcmp(&h->tg->cells[i], &h->sg->cells[i], sizeof(struct cell)) != 0) ADD(diff, i);
+    }
+  }
+  return found;
+}
+
+
+/********************************************************************************
+*** Keeps an unavoidable set, if it's new.
+*** Returns boolean success or failure (if there's no memory).
+********************************************************************************/
+static int
+keep_set(h, set)
+  struct hunt *h;
+  unsigned long long *set;
+{
+  unsigned long long *p;
+  int i,k,n;
+  int *q;
+
+  for (n=0, k=0; k<h->words; k++) {
+    n += __builtin_popcountll(set[k]);
+  }
+  for (i=0; i<h->nsets; i++) {
+    if ((h->size[i] == n) && (memcmp(h->sets + i * h->words, set, h->words * sizeof(unsigned long long)) == 0)) {
+      return 1;
+    }
+  }
+
+  if (h->nsets == h->room) {
+    h->room = h->room ? 2*h->room : 256;
+    p = (unsigned long long *) realloc(h->sets, h->room * h->words * sizeof(unsigned long long));
+    q = (int *) realloc(h->size, h->room * sizeof(int));
+    if (p != NULL) h->sets = p;
+    if (q != NULL) h->size = q;
+    if ((p == NULL) || (q == NULL)) {
+      return 0;
+    }
+  }
+  /* keep them smallest first, which makes for the best bounds */
+  for (i=h->nsets; (i>0) && (h->size[i-1] > n); i--) {
+    h->size[i] = h->size[i-1];
+    memcpy(h->sets + i * h->words, h->sets + (i-1) * h->words, h->words * sizeof(unsigned long long));
+  }
+  h->size[i] = n;
+  memcpy(h->sets + i * h->words, set, h->words * sizeof(unsigned long long));
+  h->nsets++;
+  return 1;
+}
+
+
+/********************************************************************************
+*** Cuts the unavoidable set down to a minimal one, by seeing whether the grid
+*** can still be rearranged with each of its cells fixed in turn, and keeps it.
+*** Returns boolean success or failure.
+********************************************************************************/
+static int
+add_set(h, set)
+  struct hunt *h;
+  unsigned long long *set;
+{
+  int i,k;
+  for (i=0; i<h->gr->ncells; i++) {
+    if (!HAS(set, i)) continue;
+    memset(h->spare, 0xff, h->words * sizeof(unsigned long long));
+    for (k=0; k<h->words; k++) {
+      h->spare[k] &= ~set[k];
+    }
+    ADD(h->spare, i);
+    set_puzzle(h, h->spare);
+    if (other_grid(h, h->spare) == 1) {
+      memcpy(set, h->spare, h->words * sizeof(unsigned long long));
+    }
+  }
+  return keep_set(h, set);
+}
+
+
+/********************************************************************************
+*** Adds the sets hunt from knows to those of hunt h.
+*** Returns boolean success or failure.
+********************************************************************************/
+static int
+share_sets(h, from)
+  struct hunt *h,*from;
+{
+  int i;
+  for (i=0; i<from->nsets; i++) {
+    if (!keep_set(h, from->sets + i * from->words)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+
+/********************************************************************************
+*** Starts hunt h on the grid and target of hunt from, with the sets it knows,
+*** to carry on with its tasks. Returns boolean success or failure.
+********************************************************************************/
+static int
+join_hunt(h, from)
+  struct hunt *h,*from;
+{
+  h->sg = from->sg;
+  h->target = from->target;
+  h->failed = 0;
+  h->nsets = 0;
+  return share_sets(h, from);
+}
+
+
+
+/********************************************************************************
+*** Keeps where a solution counted by values_sets() differs from the grid.
+********************************************************************************/
+static void
+keep_alt(h, g)
+  struct hunt *h;
+  struct grid *g;
+{
+  unsigned long long *diff;
+  int i,same;
+  if (h->nalts < HUNT_ALTS) {
+    diff = h->alts + h->nalts * h->words;
+    memset(diff, 0, h->words * sizeof(unsigned long long));
+    for (same=1, i=0; i<h->gr->ncells; i++) {
+      if (memcmp(&g->cells[i], &h->sg->cells[i], sizeof(struct cell)) != 0) {
+        ADD(diff, i);
+        same = 0;
+      }
+    }
+    /* the grid itself is one of the solutions */
+    if (!same) h->nalts++;
+  }
+}
+
+
+/********************************************************************************
+*** Finds the unavoidable sets in the cells holding the values of mask, and any
+*** of their subsets with fewer than n more values starting from value v.
+*** Returns boolean success or failure.
+********************************************************************************/
+static int
+values_sets(h, mask, v, n)
+  struct hunt *h;
+  int mask,v,n;
+{
+  int i,k;
+  if ((mask & (mask - 1)) != 0) {
+    memset(h->spare, 0, h->words * sizeof(unsigned long long));
+    for (i=0; i<h->gr->ncells; i++) {
+      if (!(mask & (1 << get_value(&h->sg->cells[i])))) ADD(h->spare, i);
+    }
+    set_puzzle(h, h->spare);
+    reset_solver(h->s);
+    h->nalts = 0;
+    h->s->each = keep_alt;
+    h->s->each_arg = (char *) h;
+    count_grid(h->s, h->pg, h->tg, (long) HUNT_ALTS + 1);
+    h->s->each = NULL;
+    for (k=0; k<h->nalts; k++) {
+      /* add_set() searches, so it can only start once the count is done */
+      memcpy(h->branch, h->alts + k * h->words, h->words * sizeof(unsigned long long));
+      if (!add_set(h, h->branch)) {
+        return 0;
+      }
+    }
+  }
+  for (; (n>0) && (v<=MAX_VAL); v++) {
+    if (!values_sets(h, mask | (1 << v), v + 1, n - 1)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+
+/********************************************************************************
+*** Starts a hunt of the solution grid sg, finding its first unavoidable sets.
+*** Returns boolean success or failure.
+********************************************************************************/
+static int
+start_hunt(h, sg)
+  struct hunt *h;
+  struct grid *sg;
+{
+  unsigned long long *diff;
+  int n,t,i,j,k;
+  int *order;
+
+  h->sg = sg;
+  h->nsets = 0;
+  h->failed = 0;
+  if ((diff = (unsigned long long *) malloc(h->words * sizeof(unsigned long long))) == NULL) {
+    return 0;
+  }
+  order = h->s->order;
+  n = h->gr->ncells - h->gr->nholes;
+  for (k=0; k<n; k++) {
+    order[k] = h->gr->line_cell[k];
+  }
+  if ((MAX_VAL < 8*sizeof(int) - 1) && !values_sets(h, 0, 1, HUNT_VALUES)) {
+    free(diff);
+    return 0;
+  }
+  for (t=0; t<HUNT_TRIES; t++) {
+    /* leave a random quarter of the cells as clues */
+    memset(h->spare, 0, h->words * sizeof(unsigned long long));
+    for (k=0; k<n/4; k++) {
+      j = k + random_next(h->s) % (n - k);
+      i = order[k];
+      order[k] = order[j];
+      order[j] = i;
+      ADD(h->spare, order[k]);
+    }
+    set_puzzle(h, h->spare);
+    if ((other_grid(h, diff) == 1) && !add_set(h, diff)) {
+      free(diff);
+      return 0;
+    }
+  }
+  free(diff);
+  return !h->failed;
+}
+
+
+/********************************************************************************
+*** Checks that every clue of a puzzle that has just the one solution is needed.
+*** Returns 1 if so, 0 if not and -1 if it fails.
+********************************************************************************/
+static int
+minimal_puzzle(h)
+  struct hunt *h;
+{
+  unsigned long long *set;
+  int i,j,k,needed;
+
+  for (i=0; i<h->gr->ncells; i++) {
+    if (!HAS(h->clues, i)) continue;
+    /* a clue is needed if it's the only one hitting a set */
+    for (needed=0, j=0; (j<h->nsets) && !needed; j++) {
+      set = h->sets + j * h->words;
+      if (!HAS(set, i)) continue;
+      for (needed=1, k=0; k<h->words; k++) {
+        if ((set[k] & h->clues[k]) & ~(k == i/64 ? 1ULL << (i%64) : 0)) needed = 0;
+      }
+    }
+    if (needed) continue;
+    DROP(h->clues, i);
+    set_puzzle(h, h->clues);
+    ADD(h->clues, i);
+    switch (other_grid(h, h->diff)) {
+    case -1:
+      return -1;
+    case 0:
+      return 0;
+    }
+    if (!add_set(h, h->diff)) {
+      h->failed = 1;
+      return -1;
+    }
+  }
+  return 1;
+}
+
+
+/********************************************************************************
+*** Hunts on from a branch with n clues, or hands it out as a task if it's at the
+*** depth to split at. Returns boolean success or failure.
+********************************************************************************/
+static int
+hunt_search(h, n)
+  struct hunt *h;
+  int n;
+{
+  unsigned long long *set,*b,*p;
+  int i,k,best,fewest,left,disjoint,r;
+
+  for (;;) {
+    /* find the unhit set with fewest cells to choose from, and a bound */
+    best = -1;
+    fewest = h->gr->ncells + 1;
+    disjoint = 0;
+    memset(h->spare, 0, h->words * sizeof(unsigned long long));
+    for (i=0; i<h->nsets; i++) {
+      set = h->sets + i * h->words;
+      for (k=0; (k<h->words) && !(set[k] & h->clues[k]); k++);
+      if (k < h->words) continue;
+      for (left=0, k=0; k<h->words; k++) {
+        left += __builtin_popcountll(set[k] & ~h->dead[k]);
+      }
+      if (left == 0) {
+        return 1;
+      }
+      if (left < fewest) {
+        fewest = left;
+        best = i;
+      }
+      for (k=0; (k<h->words) && !(set[k] & ~h->dead[k] & h->spare[k]); k++);
+      if (k == h->words) {
+        disjoint++;
+        for (k=0; k<h->words; k++) {
+          h->spare[k] |= set[k] & ~h->dead[k];
+        }
+      }
+    }
+    if (n + disjoint > h->target) {
+      return 1;
+    }
+    if (best >= 0) break;
+
+    /* every set is hit: a puzzle, or the way to another set */
+    set_puzzle(h, h->clues);
+    if ((r = other_grid(h, h->diff)) < 0) {
+      return 0;
+    }
+    if (r == 0) {
+      if (n < h->target) return 1;
+      if ((r = minimal_puzzle(h)) < 0) return 0;
+      if (r == 1) {
+        set_puzzle(h, h->clues);
+        (*h->found)(h->arg, h->pg);
+      }
+      return 1;
+    }
+    if (!add_set(h, h->diff)) {
+      h->failed = 1;
+      return 0;
+    }
+  }
+
+  if (n == h->split) {
+    if (h->ntasks == h->task_room) {
+      h->task_room = h->task_room ? 2*h->task_room : 64;
+      p = (unsigned long long *) realloc(h->tasks, h->task_room * 2 * h->words * sizeof(unsigned long long));
+      if (p == NULL) {
+        h->failed = 1;
+        return 0;
+      }
+      h->tasks = p;
+    }
+    memcpy(h->tasks + h->ntasks * 2 * h->words, h->clues, 2 * h->words * sizeof(unsigned long long));
+    h->ntasks++;
+    return 1;
+  }
+
+  /* branch on each cell of the set, ruling it out of the branches after it;
+  ** the last clue has to hit every set left, so it's one of the cells in all
+  ** of them */
+  b = h->branch + n * h->words;
+  set = h->sets + best * h->words;
+  for (k=0; k<h->words; k++) {
+    b[k] = set[k] & ~h->dead[k];
+  }
+  for (i=0; (n == h->target - 1) && (i<h->nsets); i++) {
+    set = h->sets + i * h->words;
+    for (k=0; (k<h->words) && !(set[k] & h->clues[k]); k++);
+    if (k < h->words) continue;
+    for (k=0; k<h->words; k++) {
+      b[k] &= set[k];
+    }
+  }
+  for (i=0; i<h->gr->ncells; i++) {
+    if (!HAS(b, i)) continue;
+    ADD(h->clues, i);
+    r = hunt_search(h, n + 1);
+    DROP(h->clues, i);
+    if (!r) return 0;
+    ADD(h->dead, i);
+  }
+  for (k=0; k<h->words; k++) {
+    h->dead[k] &= ~b[k];
+  }
+  return 1;
+}
+
+/********************************************************************************
+*** Carries on a hunt with task k of hunt from. Returns boolean success or failure.
+********************************************************************************/
+static int
+hunt_task(h, from, k)
+  struct hunt *h,*from;
+  long k;
+{
+  memcpy(h->clues, from->tasks + k * 2 * from->words, 2 * h->words * sizeof(unsigned long long));
+  return hunt_search(h, from->split);
+}
+#endif
+
+
+/********************************************************************************
+*** Rating how hard a puzzle is for a person. The rater fills in the puzzle with
+*** the techniques people use, always trying the easiest first and going back to
+*** the easiest after each one that gets anywhere, so the hardest technique it
+*** needs is the one a person can't do without. That technique's rating is the
+*** puzzle's, on the scale of Sudoku Explainer, kept in tenths (23 for 2.3). For
+*** speed, a technique is used everywhere it applies in one go before going back
+*** to the easiest: that can change how often each technique is counted, but not
+*** which is the hardest. Past the subsets, fish and wings, a trial puts each
+*** candidate in its cell and follows the singles after it, taking the candidate
+*** out if they come to a contradiction: that's Nishio, rated at the bottom of
+*** its range on the same scale, and anything harder is rated as guessing. The
+*** candidates of a cell are a single word, bit v-1 for value v, with RATE_DONE
+*** set once the cell is filled in, so grids of more than 63 values can't be
+*** rated. The places each value has left in each unit are kept up to date as
+*** candidates go, so finding hidden singles and subsets is a look up rather
+*** than a count, and a trial copies the lot as one block. Fish need the rows
+*** and columns of the classic rules; the rest works on the units of any graph,
+*** although killer cages are left out. The same techniques give hints: with
+*** rt->hint set each stops at the first place it gets anywhere, and notes down
+*** what it did there and the cells it came from.
+********************************************************************************/
+#define T_HIDDEN_BOX 0         /* hidden single in a box (or any unit not a line) */
+#define T_HIDDEN_LINE 1        /* hidden single in a row or column */
+#define T_NAKED_SINGLE 2
+#define T_POINTING 3           /* a box's candidates for a value all in one line */
+#define T_CLAIMING 4           /* a line's candidates for a value all in one box */
+#define T_NAKED_PAIR 5
+#define T_X_WING 6
+#define T_HIDDEN_PAIR 7
+#define T_NAKED_TRIPLE 8
+#define T_SWORDFISH 9
+#define T_HIDDEN_TRIPLE 10
+#define T_XY_WING 11
+#define T_XYZ_WING 12
+#define T_NAKED_QUAD 13
+#define T_JELLYFISH 14
+#define T_HIDDEN_QUAD 15
+#define T_NISHIO 16
+#define T_GUESS 17             /* none of the above gets anywhere */
+#define TECHNIQUES 18
+
+#define RATE_DONE (1ULL << 63)
+#define RATE_ALL (MAX_VAL >= 63 ? RATE_DONE - 1 : (1ULL << MAX_VAL) - 1)
+#define RATE_COUNT(m) __builtin_popcountll(m)
+#define RATE_FIRST(m) __builtin_ctzll(m)
+
+#define UNIT_BOX 0
+#define UNIT_ROW 1
+#define UNIT_COL 2
+
+struct rater {
+  struct graph *gr;
+  unsigned long long *cand;     /* the candidates of each cell, */
+  unsigned long long *where;    /* the places of each value in each unit, as bits, */
+  unsigned long long *placed;   /* and the values filled in in each unit: */
+  unsigned long long *state;    /* all of them in one block, */
+  unsigned long long *trial;    /* and a copy for trials */
+  long state_size;
+  int left;                     /* cells not yet filled in */
+  int *cell_start;              /* cell i is in units cell_unit[cell_start[i]] .. */
+  int *cell_unit;               /* .. cell_unit[cell_start[i+1]-1], */
+  int *cell_place;              /* at these places in them */
+  int *kind;                    /* UNIT_BOX, UNIT_ROW or UNIT_COL for each unit */
+  int *pairs;                   /* units u,v sharing more than one cell, */
+  unsigned long long *shared;   /* the places of u's cells in v and v's in u, */
+  int npairs;                   /* and how many there are */
+  int words;                    /* words in a set of cells */
+  unsigned long long *peer_set; /* the peers of each cell, as a set */
+  long steps[TECHNIQUES];       /* number of times each technique got somewhere */
+  int hardest;                  /* the hardest technique needed, or -1 */
+  int hint;                     /* set to stop at the first deduction, */
+  int fill_cell,fill_value;     /* the cell it fills in and its value, or -1, */
+  int *out_cell;                /* the cells it takes candidates out of, */
+  unsigned long long *out_cand; /* and which, */
+  int nout;
+  int *why;                     /* and the cells it comes from */
+  int nwhy;
+};
+
+
+/********************************************************************************
+*** The name and rating of each technique.
+********************************************************************************/
+static const char *
+technique_name(t)
+  int t;
+{
+  switch (t) {
+  case T_HIDDEN_BOX: return "Hidden single in a box";
+  case T_HIDDEN_LINE: return "Hidden single";
+  case T_NAKED_SINGLE: return "Naked single";
+  case T_POINTING: return "Pointing";
+  case T_CLAIMING: return "Claiming";
+  case T_NAKED_PAIR: return "Naked pair";
+  case T_X_WING: return "X-wing";
+  case T_HIDDEN_PAIR: return "Hidden pair";
+  case T_NAKED_TRIPLE: return "Naked triple";
+  case T_SWORDFISH: return "Swordfish";
+  case T_HIDDEN_TRIPLE: return "Hidden triple";
+  case T_XY_WING: return "XY-wing";
+  case T_XYZ_WING: return "XYZ-wing";
+  case T_NAKED_QUAD: return "Naked quad";
+  case T_JELLYFISH: return "Jellyfish";
+  case T_HIDDEN_QUAD: return "Hidden quad";
+  case T_NISHIO: return "Nishio";
+  case T_GUESS: return "Guessing";
+  }
+  return "None";
+}
+
+static int
+technique_rating(t)
+  int t;
+{
+  switch (t) {
+  case T_HIDDEN_BOX: return 12;
+  case T_HIDDEN_LINE: return 15;
+  case T_NAKED_SINGLE: return 23;
+  case T_POINTING: return 26;
+  case T_CLAIMING: return 28;
+  case T_NAKED_PAIR: return 30;
+  case T_X_WING: return 32;
+  case T_HIDDEN_PAIR: return 34;
+  case T_NAKED_TRIPLE: return 36;
+  case T_SWORDFISH: return 38;
+  case T_HIDDEN_TRIPLE: return 40;
+  case T_XY_WING: return 42;
+  case T_XYZ_WING: return 44;
+  case T_NAKED_QUAD: return 50;
+  case T_JELLYFISH: return 52;
+  case T_HIDDEN_QUAD: return 54;
+  case T_NISHIO: return 76;
+  case T_GUESS: return 100;
+  }
+  return 0;
+}
+
+
+/* points the rater at the state in block */
+static void
+set_state(rt, block)
+  struct rater *rt;
+  unsigned long long *block;
+{
+  rt->cand = block;
+  rt->where = block + rt->gr->ncells;
+  rt->placed = rt->where + rt->gr->nunits * MAX_VAL;
+}
+
+
+static void
+free_rater(rt)
+  struct rater *rt;
+{
+  if (rt != NULL) {
+    free(rt->state);
+    free(rt->trial);
+    free(rt->cell_start);
+    free(rt->cell_unit);
+    free(rt->cell_place);
+    free(rt->kind);
+    free(rt->pairs);
+    free(rt->shared);
+    free(rt->peer_set);
+    free(rt->out_cell);
+    free(rt->out_cand);
+    free(rt->why);
+    free(rt);
+  }
+}
+
+
+/********************************************************************************
+*** Makes a rater for the puzzles of a graph, working out the kind of each unit
+*** and which units overlap. Returns NULL if there's no memory.
+********************************************************************************/
+static struct rater *
+new_rater(gr)
+  struct graph *gr;
+{
+  struct rater *rt;
+  int u,v,i,j,k,n,row,col;
+  unsigned long long m,mv;
+
+  if ((rt = (struct rater *) calloc(1, sizeof(struct rater))) == NULL) {
+    return NULL;
+  }
+  rt->gr = gr;
+  rt->words = (gr->ncells + 63) / 64;
+  rt->state_size = gr->ncells + gr->nunits * (MAX_VAL + 1);
+  rt->state = (unsigned long long *) malloc(rt->state_size * sizeof(unsigned long long));
+  rt->trial = (unsigned long long *) malloc(rt->state_size * sizeof(unsigned long long));
+  n = gr->unit_start[gr->nunits];
+  rt->cell_start = (int *) calloc(gr->ncells + 1, sizeof(int));
+  rt->cell_unit = (int *) malloc((n + 1) * sizeof(int));
+  rt->cell_place = (int *) malloc((n + 1) * sizeof(int));
+  rt->kind = (int *) malloc((gr->nunits + 1) * sizeof(int));
+  rt->peer_set = (unsigned long long *) calloc(gr->ncells * rt->words, sizeof(unsigned long long));
+  rt->out_cell = (int *) malloc(gr->ncells * sizeof(int));
+  rt->out_cand = (unsigned long long *) malloc(gr->ncells * sizeof(unsigned long long));
+  rt->why = (int *) malloc(gr->ncells * sizeof(int));
+  if ((rt->state == NULL) || (rt->trial == NULL) || (rt->cell_start == NULL) || (rt->cell_unit == NULL)
+      || (rt->cell_place == NULL) || (rt->kind == NULL) || (rt->peer_set == NULL)
+      || (rt->out_cell == NULL) || (rt->out_cand == NULL) || (rt->why == NULL)) {
+    free_rater(rt);
+    return NULL;
+  }
+  set_state(rt, rt->state);
+  for (i=0; i<gr->ncells; i++) {
+    for (k=gr->peer_start[i]; k<gr->peer_start[i+1]; k++) {
+      ADD(rt->peer_set + i * rt->words, gr->peers[k]);
+    }
+  }
+  /* the units of each cell, counted and then filled in */
+  for (k=0; k<n; k++) {
+    rt->cell_start[gr->unit_cells[k] + 1]++;
+  }
+  for (i=0; i<gr->ncells; i++) {
+    rt->cell_start[i+1] += rt->cell_start[i];
+  }
+  for (u=0; u<gr->nunits; u++) {
+    for (k=gr->unit_start[u]; k<gr->unit_start[u+1]; k++) {
+      i = gr->unit_cells[k];
+      j = rt->cell_start[i]++;
+      rt->cell_unit[j] = u;
+      rt->cell_place[j] = k - gr->unit_start[u];
+    }
+  }
+  for (i=gr->ncells; i>0; i--) {
+    rt->cell_start[i] = rt->cell_start[i-1];
+  }
+  rt->cell_start[0] = 0;
+  for (u=0; u<gr->nunits; u++) {
+    row = col = 1;
+    for (k=gr->unit_start[u]; k<gr->unit_start[u+1]; k++) {
+      i = gr->unit_cells[k];
+      j = gr->unit_cells[gr->unit_start[u]];
+      if (i / gr->cols != j / gr->cols) row = 0;
+      if (i % gr->cols != j % gr->cols) col = 0;
+    }
+    rt->kind[u] = row ? UNIT_ROW : col ? UNIT_COL : UNIT_BOX;
+  }
+  /* every two units sharing more than one cell, both ways round */
+  for (n=0, u=0; u<gr->nunits; u++) {
+    for (v=0; v<gr->nunits; v++) {
+      if (u == v) continue;
+      for (m=0, mv=0, k=gr->unit_start[u]; k<gr->unit_start[u+1]; k++) {
+        for (j=gr->unit_start[v]; j<gr->unit_start[v+1]; j++) {
+          if (gr->unit_cells[j] != gr->unit_cells[k]) continue;
+          m |= 1ULL << (k - gr->unit_start[u]);
+          mv |= 1ULL << (j - gr->unit_start[v]);
+        }
+      }
+      if (RATE_COUNT(m) < 2) continue;
+      if (n % 64 == 0) {
+        rt->pairs = (int *) realloc(rt->pairs, (n + 64) * 2 * sizeof(int));
+        rt->shared = (unsigned long long *) realloc(rt->shared, (n + 64) * 2 * sizeof(unsigned long long));
+        if ((rt->pairs == NULL) || (rt->shared == NULL)) {
+          free_rater(rt);
+          return NULL;
+        }
+      }
+      rt->pairs[2*n] = u;
+      rt->pairs[2*n+1] = v;
+      rt->shared[2*n] = m;
+      rt->shared[2*n+1] = mv;
+      n++;
+    }
+  }
+  rt->npairs = n;
+  return rt;
+}
+
+
+/* takes the candidates in m, which cell i has, out of it and its units */
+static void
+rate_remove(rt, i, m)
+  struct rater *rt;
+  int i;
+  unsigned long long m;
+{
+  unsigned long long *w,b;
+  int k;
+  rt->cand[i] &= ~m;
+  for (k=rt->cell_start[i]; k<rt->cell_start[i+1]; k++) {
+    w = rt->where + rt->cell_unit[k] * MAX_VAL;
+    for (b=m; b; b&=b-1) {
+      w[RATE_FIRST(b)] &= ~(1ULL << rt->cell_place[k]);
+    }
+  }
+}
+
+
+/********************************************************************************
+*** Fills in value v (counting from 0) in cell i, taking it out of the cell's
+*** peers. Returns 0, or -1 if it isn't a candidate there or that leaves a peer
+*** with no candidates.
+********************************************************************************/
+static int
+rate_place(rt, i, v)
+  struct rater *rt;
+  int i,v;
+{
+  struct graph *gr;
+  unsigned long long b,c;
+  int j,k;
+
+  gr = rt->gr;
+  b = 1ULL << v;
+  if ((rt->cand[i] & RATE_DONE) || !(rt->cand[i] & b)) {
+    return -1;
+  }
+  rate_remove(rt, i, rt->cand[i] & ~b);
+  for (k=rt->cell_start[i]; k<rt->cell_start[i+1]; k++) {
+    rt->where[rt->cell_unit[k] * MAX_VAL + v] = 0;
+    rt->placed[rt->cell_unit[k]] |= b;
+  }
+  rt->cand[i] = b | RATE_DONE;
+  rt->left--;
+  for (k=gr->peer_start[i]; k<gr->peer_start[i+1]; k++) {
+    j = gr->peers[k];
+    c = rt->cand[j];
+    if (!(c & b)) continue;
+    if ((c & RATE_DONE) || (c == b)) {
+      return -1;
+    }
+    rate_remove(rt, j, b);
+  }
+  return 0;
+}
+
+
+/* takes the candidates in m out of cell i, noting them down for a hint: returns
+** 1 if any were there, 0 if none, and -1 if that leaves none */
+static int
+rate_clear(rt, i, m)
+  struct rater *rt;
+  int i;
+  unsigned long long m;
+{
+  if ((rt->cand[i] & RATE_DONE) || !(m &= rt->cand[i])) {
+    return 0;
+  }
+  if (rt->hint) {
+    rt->out_cell[rt->nout] = i;
+    rt->out_cand[rt->nout++] = m;
+  }
+  rate_remove(rt, i, m);
+  return rt->cand[i] == 0 ? -1 : 1;
+}
+
+/* notes down the cells of unit u at the places in m as cells a hint comes from */
+static void
+hint_unit(rt, u, m)
+  struct rater *rt;
+  int u;
+  unsigned long long m;
+{
+  for (; m; m&=m-1) {
+    rt->why[rt->nwhy++] = rt->gr->unit_cells[rt->gr->unit_start[u] + RATE_FIRST(m)];
+  }
+}
+
+
+/********************************************************************************
+*** Hidden singles in the boxes (if box is set) or the lines. Returns the number
+*** of cells filled in, or -1 on a contradiction.
+********************************************************************************/
+static int
+hidden_singles(rt, box)
+  struct rater *rt;
+  int box;
+{
+  struct graph *gr;
+  unsigned long long *where,left;
+  int u,v,i,n,size;
+
+  gr = rt->gr;
+  for (n=0, u=0; u<gr->nunits; u++) {
+    /* a unit smaller than the number of values needn't have every value */
+    size = gr->unit_start[u+1] - gr->unit_start[u];
+    if (((rt->kind[u] == UNIT_BOX) != box) || (size < MAX_VAL)) continue;
+    where = rt->where + u * MAX_VAL;
+    for (left=RATE_ALL & ~rt->placed[u]; left; left&=left-1) {
+      v = RATE_FIRST(left);
+      if (where[v] == 0) {
+        return -1;
+      }
+      if (where[v] & (where[v] - 1)) continue;
+      i = gr->unit_cells[gr->unit_start[u] + RATE_FIRST(where[v])];
+      if (rate_place(rt, i, v) < 0) {
+        return -1;
+      }
+      n++;
+      if (rt->hint) {
+        rt->fill_cell = i;
+        rt->fill_value = v;
+        hint_unit(rt, u, size == 64 ? ~0ULL : (1ULL << size) - 1);
+        return n;
+      }
+    }
+  }
+  return n;
+}
+
+
+/********************************************************************************
+*** Naked singles. Returns the number of cells filled in, or -1 on a
+*** contradiction.
+********************************************************************************/
+static int
+naked_singles(rt)
+  struct rater *rt;
+{
+  unsigned long long c;
+  int i,n;
+  for (n=0, i=0; i<rt->gr->ncells; i++) {
+    c = rt->cand[i];
+    if ((c & RATE_DONE) || (c & (c - 1))) continue;
+    if ((c == 0) || (rate_place(rt, i, RATE_FIRST(c)) < 0)) {
+      return -1;
+    }
+    n++;
+    if (rt->hint) {
+      rt->fill_cell = i;
+      rt->fill_value = RATE_FIRST(c);
+      rt->why[rt->nwhy++] = i;
+      return n;
+    }
+  }
+  return n;
+}
+
+
+/********************************************************************************
+*** Locked candidates: where a value's candidates in one unit all lie in another,
+*** it's in none of the other unit's other cells. Pointing is from a box to a
+*** line and claiming the other way. Returns the number of cells changed, or -1
+*** on a contradiction.
+********************************************************************************/
+static int
+locked_candidates(rt, pointing)
+  struct rater *rt;
+  int pointing;
+{
+  struct graph *gr;
+  unsigned long long *where,left,outside;
+  int p,u,v,k,n,r;
+
+  gr = rt->gr;
+  for (n=0, p=0; p<rt->npairs; p++) {
+    u = rt->pairs[2*p];
+    v = rt->pairs[2*p+1];
+    if (pointing ? (rt->kind[u] != UNIT_BOX) || (rt->kind[v] == UNIT_BOX)
+                 : (rt->kind[u] == UNIT_BOX) || (rt->kind[v] != UNIT_BOX)) continue;
+    where = rt->where + u * MAX_VAL;
+    for (left=RATE_ALL & ~rt->placed[u]; left; left&=left-1) {
+      k = RATE_FIRST(left);
+      if ((where[k] == 0) || (where[k] & ~rt->shared[2*p])) continue;
+      /* k goes from v's cells outside u */
+      outside = rt->where[v * MAX_VAL + k] & ~rt->shared[2*p+1];
+      for (; outside; outside&=outside-1) {
+        if ((r = rate_clear(rt, gr->unit_cells[gr->unit_start[v] + RATE_FIRST(outside)], 1ULL << k)) < 0) {
+          return -1;
+        }
+        n += r;
+      }
+      if (rt->hint && (n > 0)) {
+        hint_unit(rt, u, where[k]);
+        return n;
+      }
+    }
+  }
+  return n;
+}
+
+
+/* moves the k indexes in idx on to the next combination of n; returns 0 after
+** the last */
+static int
+next_combination(idx, n, k)
+  int *idx;
+  int n,k;
+{
+  int i;
+  for (i=k-1; (i >= 0) && (idx[i] == n - k + i); i--);
+  if (i < 0) {
+    return 0;
+  }
+  for (idx[i]++, i++; i<k; i++) {
+    idx[i] = idx[i-1] + 1;
+  }
+  return 1;
+}
+
+
+/********************************************************************************
+*** Naked subsets of size k: k cells of a unit with k candidates between them
+*** hold those values, so no other cell of the unit does. Hidden subsets: k
+*** values of a unit with k places between them fill those places, so they hold
+*** no other values. Returns the number of cells changed, or -1 on a
+*** contradiction.
+********************************************************************************/
+static int
+subsets(rt, k, hidden)
+  struct rater *rt;
+  int k,hidden;
+{
+  struct graph *gr;
+  unsigned long long *where,m[MAX_VAL],left,all,mask;
+  int idx[4],what[MAX_VAL];
+  int u,n,c,i,j,r,start,size,open;
+
+  gr = rt->gr;
+  for (n=0, u=0; u<gr->nunits; u++) {
+    start = gr->unit_start[u];
+    size = gr->unit_start[u+1] - start;
+    where = rt->where + u * MAX_VAL;
+    left = RATE_ALL & ~rt->placed[u];
+    /* the entries to choose from: cells by their candidates, or values by
+    ** their places */
+    for (c=0, open=0, i=0; i<(hidden ? MAX_VAL : size); i++) {
+      if (hidden) {
+        if (!(left & (1ULL << i))) continue;
+        if (size < MAX_VAL) break;
+        all = where[i];
+      }
+      else {
+        all = rt->cand[gr->unit_cells[start + i]];
+        if (all & RATE_DONE) continue;
+      }
+      open++;
+      if (RATE_COUNT(all) > k) continue;
+      m[c] = all;
+      what[c++] = i;
+    }
+    if ((c < k) || (open <= k)) continue;
+    for (i=0; i<k; i++) idx[i] = i;
+    do {
+      for (all=0, i=0; i<k; i++) all |= m[idx[i]];
+      if (RATE_COUNT(all) != k) continue;
+      if (hidden) {
+        /* the k values take the places in all */
+        for (mask=0, i=0; i<k; i++) mask |= 1ULL << what[idx[i]];
+        for (; all; all&=all-1) {
+          if ((r = rate_clear(rt, gr->unit_cells[start + RATE_FIRST(all)], RATE_ALL & ~mask)) < 0) {
+            return -1;
+          }
+          n += r;
+        }
+      }
+      else {
+        /* the k cells take the values in all */
+        for (mask=0, i=0; i<k; i++) mask |= 1ULL << what[idx[i]];
+        for (j=0; j<size; j++) {
+          if (mask & (1ULL << j)) continue;
+          if ((r = rate_clear(rt, gr->unit_cells[start + j], all)) < 0) {
+            return -1;
+          }
+          n += r;
+        }
+      }
+      if (rt->hint && (n > 0)) {
+        /* the cells of the subset, or the places of its values */
+        for (all=0, i=0; i<k; i++) all |= hidden ? m[idx[i]] : 1ULL << what[idx[i]];
+        hint_unit(rt, u, all);
+        return n;
+      }
+    } while (next_combination(idx, c, k));
+  }
+  return n;
+}
+
+
+/********************************************************************************
+*** Fish of size k (X-wing, swordfish, jellyfish), on the classic rules: k rows
+*** whose candidates for a value lie in k columns between them take that value
+*** in those columns, so no other row does; and the same the other way round.
+*** Returns the number of cells changed, or -1 on a contradiction.
+********************************************************************************/
+static int
+fish(rt, k)
+  struct rater *rt;
+  int k;
+{
+  unsigned long long m[ROWS],all,b;
+  int idx[4],line[ROWS];
+  int v,d,a,c,x,i,j,n,r,cell;
+
+  if (!classic_rules(rt->gr)) {
+    return 0;
+  }
+  for (n=0, v=0; v<MAX_VAL; v++) {
+    b = 1ULL << v;
+    for (d=0; d<2; d++) {
+      /* d 0 has the rows as the base, d 1 the columns */
+      for (c=0, a=0; a<ROWS; a++) {
+        for (all=0, x=0; x<COLS; x++) {
+          cell = d ? x*COLS + a : a*COLS + x;
+          if (rt->cand[cell] & RATE_DONE) {
+            if (rt->cand[cell] & b) break;
+            continue;
+          }
+          if (rt->cand[cell] & b) all |= 1ULL << x;
+        }
+        if ((x < COLS) || (RATE_COUNT(all) < 2) || (RATE_COUNT(all) > k)) continue;
+        m[c] = all;
+        line[c++] = a;
+      }
+      if (c < k) continue;
+      for (i=0; i<k; i++) idx[i] = i;
+      do {
+        for (all=0, i=0; i<k; i++) all |= m[idx[i]];
+        if (RATE_COUNT(all) != k) continue;
+        for (a=0; a<ROWS; a++) {
+          for (i=0; (i<k) && (line[idx[i]] != a); i++);
+          if (i < k) continue;
+          for (j=0; j<COLS; j++) {
+            if (!(all & (1ULL << j))) continue;
+            if ((r = rate_clear(rt, d ? j*COLS + a : a*COLS + j, b)) < 0) {
+              return -1;
+            }
+            n += r;
+          }
+        }
+        if (rt->hint && (n > 0)) {
+          /* the candidates of the base lines */
+          for (i=0; i<k; i++) {
+            a = line[idx[i]];
+            for (all=m[idx[i]]; all; all&=all-1) {
+              j = RATE_FIRST(all);
+              rt->why[rt->nwhy++] = d ? j*COLS + a : a*COLS + j;
+            }
+          }
+          return n;
+        }
+      } while (next_combination(idx, c, k));
+    }
+  }
+  return n;
+}
+
+
+/********************************************************************************
+*** Wings. An XY-wing is a cell of two candidates xy seeing a cell xz and a cell
+*** yz: whichever the first cell holds, one of the others holds z, so no cell
+*** seeing both of them does. An XYZ-wing is the same with the first cell xyz,
+*** so it has to see the cell too. Returns the number of cells changed, or -1 on
+*** a contradiction.
+********************************************************************************/
+static int
+wings(rt, xyz)
+  struct rater *rt;
+  int xyz;
+{
+  struct graph *gr;
+  unsigned long long cp,cq,cr,z,*ps;
+  int p,q,r,i,j,k,n,x;
+
+  gr = rt->gr;
+  for (n=0, p=0; p<gr->ncells; p++) {
+    cp = rt->cand[p];
+    if ((cp & RATE_DONE) || (RATE_COUNT(cp) != (xyz ? 3 : 2))) continue;
+    for (j=gr->peer_start[p]; j<gr->peer_start[p+1]; j++) {
+      q = gr->peers[j];
+      cq = rt->cand[q];
+      if ((cq & RATE_DONE) || (RATE_COUNT(cq) != 2)) continue;
+      if (xyz ? (cq & ~cp) != 0 : RATE_COUNT(cq & cp) != 1) continue;
+      for (k=j+1; k<gr->peer_start[p+1]; k++) {
+        r = gr->peers[k];
+        cr = rt->cand[r];
+        if ((cr & RATE_DONE) || (RATE_COUNT(cr) != 2) || (cr == cq)) continue;
+        if (xyz) {
+          if ((cr & ~cp) || ((cq | cr) != cp)) continue;
+          z = cq & cr;
+        }
+        else {
+          z = cq & ~cp;
+          if ((RATE_COUNT(cr & cp) != 1) || ((cr & cp) == (cq & cp)) || ((cr & ~cp) != z)) continue;
+        }
+        /* z goes from every cell seeing both ends (and the middle, for XYZ) */
+        ps = rt->peer_set + r * rt->words;
+        for (i=gr->peer_start[q]; i<gr->peer_start[q+1]; i++) {
+          x = gr->peers[i];
+          if ((x == p) || (x == r) || !HAS(ps, x)) continue;
+          if (xyz && !HAS(rt->peer_set + p * rt->words, x)) continue;
+          switch (rate_clear(rt, x, z)) {
+          case -1: return -1;
+          case 1: n++;
+          }
+        }
+        if (rt->hint && (n > 0)) {
+          rt->why[rt->nwhy++] = p;
+          rt->why[rt->nwhy++] = q;
+          rt->why[rt->nwhy++] = r;
+          return n;
+        }
+      }
+    }
+  }
+  return n;
+}
+
+
+/********************************************************************************
+*** Nishio: each candidate is tried in its cell, following the singles after it,
+*** and taken out if they come to a contradiction. Returns the number of
+*** candidates taken out, or -1 on a contradiction.
+********************************************************************************/
+static int
+nishio(rt)
+  struct rater *rt;
+{
+  unsigned long long *real,c;
+  int i,v,n,r,found,left,hint;
+
+  real = rt->cand;
+  left = rt->left;
+  hint = rt->hint;
+  for (n=0, i=0; i<rt->gr->ncells; i++) {
+    if (real[i] & RATE_DONE) continue;
+    for (c=real[i]; c; c&=c-1) {
+      v = RATE_FIRST(c);
+      memcpy(rt->trial, real, rt->state_size * sizeof(unsigned long long));
+      set_state(rt, rt->trial);
+      rt->hint = 0;
+      r = rate_place(rt, i, v);
+      for (found=1; (r == 0) && (found > 0) && (rt->left > 0); r=0) {
+        if ((r = hidden_singles(rt, 1)) < 0) break;
+        found = r;
+        if ((r = hidden_singles(rt, 0)) < 0) break;
+        found += r;
+        if ((r = naked_singles(rt)) < 0) break;
+        found += r;
+      }
+      set_state(rt, real);
+      rt->left = left;
+      rt->hint = hint;
+      if (r >= 0) continue;
+      if (rate_clear(rt, i, 1ULL << v) < 0) {
+        return -1;
+      }
+      n++;
+      if (rt->hint) {
+        rt->why[rt->nwhy++] = i;
+        return n;
+      }
+    }
+  }
+  return n;
+}
+
+
+/********************************************************************************
+*** Uses technique t wherever it applies. Returns the number of cells changed,
+*** or -1 on a contradiction.
+********************************************************************************/
+static int
+use_technique(rt, t)
+  struct rater *rt;
+  int t;
+{
+  switch (t) {
+  case T_HIDDEN_BOX: return hidden_singles(rt, 1);
+  case T_HIDDEN_LINE: return hidden_singles(rt, 0);
+  case T_NAKED_SINGLE: return naked_singles(rt);
+  case T_POINTING: return locked_candidates(rt, 1);
+  case T_CLAIMING: return locked_candidates(rt, 0);
+  case T_NAKED_PAIR: return subsets(rt, 2, 0);
+  case T_X_WING: return fish(rt, 2);
+  case T_HIDDEN_PAIR: return subsets(rt, 2, 1);
+  case T_NAKED_TRIPLE: return subsets(rt, 3, 0);
+  case T_SWORDFISH: return fish(rt, 3);
+  case T_HIDDEN_TRIPLE: return subsets(rt, 3, 1);
+  case T_XY_WING: return wings(rt, 0);
+  case T_XYZ_WING: return wings(rt, 1);
+  case T_NAKED_QUAD: return subsets(rt, 4, 0);
+  case T_JELLYFISH: return fish(rt, 4);
+  case T_HIDDEN_QUAD: return subsets(rt, 4, 1);
+  case T_NISHIO: return nishio(rt);
+  }
+  return 0;
+}
+
+
+/********************************************************************************
+*** Sets up the rater with the candidates of the puzzle g. Returns 0, -1 if the
+*** clues clash or -2 if the puzzle can't be rated.
+********************************************************************************/
+static int
+rate_start(rt, g)
+  struct rater *rt;
+  struct grid *g;
+{
+  struct graph *gr;
+  int i,u,v,n;
+
+  gr = rt->gr;
+  memset(rt->steps, 0, sizeof(rt->steps));
+  rt->hardest = -1;
+  rt->hint = 0;
+  if (MAX_VAL > 63) {
+    return -2;
+  }
+  set_state(rt, rt->state);
+  for (i=0; i<gr->ncells; i++) {
+    rt->cand[i] = gr->hole[i] ? RATE_DONE : RATE_ALL;
+  }
+  for (u=0; u<gr->nunits; u++) {
+    n = gr->unit_start[u+1] - gr->unit_start[u];
+    for (v=0; v<MAX_VAL; v++) {
+      rt->where[u * MAX_VAL + v] = n == 64 ? ~0ULL : (1ULL << n) - 1;
+    }
+    rt->placed[u] = 0;
+  }
+  rt->left = gr->ncells - gr->nholes;
+  for (i=0; i<gr->ncells; i++) {
+    if (!gr->hole[i] && ((v = get_value(&g->cells[i])) > 0) && (rate_place(rt, i, v - 1) < 0)) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+
+/********************************************************************************
+*** Rates the puzzle g. Sets rt->hardest to the hardest technique it needed (-1
+*** if it was already full) and rt->steps to how often each was used.
+*** Returns its rating, or -1 if it has no solution and -2 if it can't be rated.
+********************************************************************************/
+static int
+rate_grid(rt, g)
+  struct rater *rt;
+  struct grid *g;
+{
+  int t,r;
+
+  if ((r = rate_start(rt, g)) < 0) {
+    return r;
+  }
+  while (rt->left > 0) {
+    for (t=0; t<T_GUESS; t++) {
+      if ((r = use_technique(rt, t)) < 0) {
+        return -1;
+      }
+      if (r > 0) break;
+    }
+    rt->steps[t]++;
+    if (t > rt->hardest) rt->hardest = t;
+    if (t == T_GUESS) break;
+  }
+  return rt->hardest < 0 ? 0 : technique_rating(rt->hardest);
+}
+
+
+/********************************************************************************
+*** Finds the easiest deduction to make next in the puzzle g: tries the
+*** techniques in order, each stopping at the first place it gets anywhere, and
+*** sets rt->hardest to the technique (-1 if g is full, T_GUESS if none gets
+*** anywhere). What it does is in rt->fill_cell and rt->fill_value, the cell it
+*** fills in and its value (counting from 0), or rt->out_cell and rt->out_cand,
+*** the candidates it takes out; and rt->why holds the cells it comes from.
+*** Returns 0, or -1 if g has no solution and -2 if it can't be rated.
+********************************************************************************/
+static int
+hint_grid(rt, g)
+  struct rater *rt;
+  struct grid *g;
+{
+  int t,r;
+
+  if ((r = rate_start(rt, g)) < 0) {
+    return r;
+  }
+  rt->hint = 1;
+  rt->fill_cell = -1;
+  rt->nout = 0;
+  rt->nwhy = 0;
+  if (rt->left == 0) {
+    return 0;
+  }
+  for (t=0; t<T_GUESS; t++) {
+    if ((r = use_technique(rt, t)) < 0) {
+      return -1;
+    }
+    if (r > 0) break;
+  }
+  rt->hardest = t;
+  return 0;
+}
+
+
+/********************************************************************************
+*** Interactive solving. A board is a grid being filled in by hand, a cell at a
+*** time, with the values that can still go in each empty cell kept up to date:
+*** each holds every value that no peer filled in has, and each filled in cell
+*** is solved with its value, so the board is a grid try() can start from.
+*** Filling in a cell clears its value from its peers and nowhere else, and
+*** every cell that changes goes on an undo log first, with a move marking
+*** where each cell filled in starts on it. Erasing a cell takes the log back
+*** to its move and fills in again the cells filled in after it, so it only
+*** touches the cells the later moves touched. Whether the board can still be
+*** solved is answered from a solution found before, while every cell filled
+*** in since agrees with it, and only searched for again when one doesn't; an
+*** empty cell with no values left can't be, without searching at all. Killer
+*** cages are left to the search.
+********************************************************************************/
+struct change {
+  int cell;                     /* the cell that changed, */
+  struct cell old;              /* and what it held before */
+};
+
+struct board {
+  struct graph *gr;
+  struct solver *s;
+  struct grid *g;               /* the cells filled in, and the values left in the rest */
+  struct grid *wg;              /* a grid to search from */
+  struct grid *sol;             /* a solution found before */
+  int known;                    /* set if sol is a solution of the clues */
+  int wrong;                    /* number of cells filled in that don't agree with sol */
+  int stuck;                    /* set if the board is known to have no solution */
+  int empty;                    /* number of empty cells with no values left */
+  struct change *log;           /* the undo log, */
+  long nlog,log_room;           /* and its length and room */
+  int *move_cell;               /* the cell filled in by each move, */
+  long *move_start;             /* and where its changes start on the log */
+  int nmoves;                   /* moves made, */
+  int nclues;                   /* the first of them being the clues */
+  int *redo;                    /* the cells and values of moves to make again */
+};
+
+
+static void
+free_board(b)
+  struct board *b;
+{
+  if (b != NULL) {
+    free_solver(b->s);
+    free(b->g);
+    free(b->wg);
+    free(b->sol);
+    free(b->log);
+    free(b->move_cell);
+    free(b->move_start);
+    free(b->redo);
+    free(b);
+  }
+}
+
+
+/********************************************************************************
+*** Makes an empty board for a graph. Returns NULL if there's no memory.
+********************************************************************************/
+static struct board *
+new_board(gr)
+  struct graph *gr;
+{
+  struct board *b;
+  if ((b = (struct board *) calloc(1, sizeof(struct board))) == NULL) {
+    return NULL;
+  }
+  b->gr = gr;
+  b->s = new_solver(gr);
+  b->g = new_grid(gr);
+  b->wg = new_grid(gr);
+  b->sol = new_grid(gr);
+  b->log_room = gr->ncells;
+  b->log = (struct change *) malloc(b->log_room * sizeof(struct change));
+  b->move_cell = (int *) malloc(gr->ncells * sizeof(int));
+  b->move_start = (long *) malloc(gr->ncells * sizeof(long));
+  b->redo = (int *) malloc(2 * gr->ncells * sizeof(int));
+  if ((b->s == NULL) || (b->g == NULL) || (b->wg == NULL) || (b->sol == NULL) || (b->log == NULL)
+      || (b->move_cell == NULL) || (b->move_start == NULL) || (b->redo == NULL)) {
+    free_board(b);
+    return NULL;
+  }
+  return b;
+}
+
+
+/********************************************************************************
+*** Empties every cell of a board.
+********************************************************************************/
+static void
+clear_board(b)
+  struct board *b;
+{
+  grid_zero(b->g, b->gr);
+  b->known = 0;
+  b->wrong = 0;
+  b->stuck = 0;
+  b->empty = 0;
+  b->nlog = 0;
+  b->nmoves = 0;
+  b->nclues = 0;
+}
+
+
+/********************************************************************************
+*** Puts cell i on the undo log, before it changes. Returns boolean success or
+*** failure (of memory).
+********************************************************************************/
+static int
+log_cell(b, i)
+  struct board *b;
+  int i;
+{
+  struct change *log;
+  if (b->nlog == b->log_room) {
+    log = (struct change *) realloc(b->log, 2 * b->log_room * sizeof(struct change));
+    if (log == NULL) {
+      return 0;
+    }
+    b->log = log;
+    b->log_room *= 2;
+  }
+  b->log[b->nlog].cell = i;
+  b->log[b->nlog].old = b->g->cells[i];
+  b->nlog++;
+  return 1;
+}
+
+
+/********************************************************************************
+*** Takes the undo log back to where it was n changes in.
+********************************************************************************/
+static void
+undo_board(b, n)
+  struct board *b;
+  long n;
+{
+  struct cell *c;
+  while (b->nlog > n) {
+    b->nlog--;
+    c = &b->g->cells[b->log[b->nlog].cell];
+    if (c->w[0] & SOLVED) b->g->solved_counter--;
+    else if (count_possibles(c) == 0) b->empty--;
+    *c = b->log[b->nlog].old;
+  }
+}
+
+
+/********************************************************************************
+*** Fills in value v in the empty cell i, and clears it from the peers.
+*** Returns SUD_SOLVED, SUD_INVALID if a peer already has v, or SUD_NO_MEMORY.
+********************************************************************************/
+static int
+board_place(b, i, v)
+  struct board *b;
+  int i,v;
+{
+  struct cell *c;
+  long start;
+  int p;
+
+  c = &b->g->cells[i];
+  if ((c->w[0] & SOLVED) || !(c->w[WORD(v)] & BIT(v))) {
+    return SUD_INVALID;
+  }
+  start = b->nlog;
+  if (!log_cell(b, i)) {
+    return SUD_NO_MEMORY;
+  }
+  for (p=b->gr->peer_start[i]; p<b->gr->peer_start[i+1]; p++) {
+    c = &b->g->cells[b->gr->peers[p]];
+    if ((c->w[0] & SOLVED) || !(c->w[WORD(v)] & BIT(v))) continue;
+    if (!log_cell(b, b->gr->peers[p])) {
+      undo_board(b, start);
+      return SUD_NO_MEMORY;
+    }
+    c->w[WORD(v)] &= ~BIT(v);
+    if (count_possibles(c) == 0) b->empty++;
+  }
+  set_value(&b->g->cells[i], v);
+  b->g->solved_counter++;
+  b->move_cell[b->nmoves] = i;
+  b->move_start[b->nmoves] = start;
+  b->nmoves++;
+  if (b->known && (get_value(&b->sol->cells[i]) != v)) b->wrong++;
+  return SUD_SOLVED;
+}
+
+
+/********************************************************************************
+*** Empties cell i, if it was filled in and isn't a clue: undoes the moves back
+*** to the one that filled it in, and makes the ones after it again.
+*** Returns SUD_SOLVED, SUD_INVALID for a clue, or SUD_NO_MEMORY.
+********************************************************************************/
+static int
+board_erase(b, i)
+  struct board *b;
+  int i;
+{
+  int k,m,n,r,known;
+
+  for (k=b->nmoves-1; (k >= 0) && (b->move_cell[k] != i); k--) ;
+  if (k < 0) {
+    return SUD_SOLVED;
+  }
+  if (k < b->nclues) {
+    return SUD_INVALID;
+  }
+  for (n=0, m=k+1; m<b->nmoves; m++, n++) {
+    b->redo[2*n] = b->move_cell[m];
+    b->redo[2*n+1] = get_value(&b->g->cells[b->move_cell[m]]);
+  }
+  if (b->known && (get_value(&b->sol->cells[i]) != get_value(&b->g->cells[i]))) b->wrong--;
+  undo_board(b, b->move_start[k]);
+  b->nmoves = k;
+  b->stuck = 0;
+  /* values only come back to the cells, so the moves can all be made again,
+  ** and they agree with sol as much as they did before */
+  known = b->known;
+  b->known = 0;
+  for (r=SUD_SOLVED, m=0; (m < n) && (r == SUD_SOLVED); m++) {
+    r = board_place(b, b->redo[2*m], b->redo[2*m+1]);
+  }
+  b->known = known;
+  return r;
+}
+
+
+/********************************************************************************
+*** Fills in the clues of the puzzle ig on an empty board, for good.
+*** Returns SUD_SOLVED, SUD_INVALID if two clues clash, or SUD_NO_MEMORY.
+********************************************************************************/
+static int
+board_puzzle(b, ig)
+  struct board *b;
+  struct grid *ig;
+{
+  int i,v,r;
+  clear_board(b);
+  for (i=0; i<b->gr->ncells; i++) {
+    if (b->gr->hole[i] || ((v = get_value(&ig->cells[i])) == 0)) continue;
+    if ((r = board_place(b, i, v)) != SUD_SOLVED) {
+      return r;
+    }
+  }
+  b->nclues = b->nmoves;
+  return SUD_SOLVED;
+}
+
+
+/********************************************************************************
+*** Says whether the board can still be solved: returns SUD_SOLVED if it can,
+*** SUD_UNSOLVABLE if not, or why the search gave up.
+********************************************************************************/
+static int
+board_solvable(b)
+  struct board *b;
+{
+  int i;
+  if ((b->empty > 0) || b->stuck) {
+    return SUD_UNSOLVABLE;
+  }
+  if (b->known && (b->wrong == 0)) {
+    return SUD_SOLVED;
+  }
+  copy_grid(b->g, b->wg);
+  for (i=0; i<b->gr->ncells; i++) {
+    if (b->wg->cells[i].w[0] & SOLVED) continue;
+    mark_if_solved(&b->wg->cells[i]);
+    if (b->wg->cells[i].w[0] & SOLVED) b->wg->solved_counter++;
+  }
+  reset_solver(b->s);
+  if (try(b->s, b->wg, b->sol)) {
+    b->known = 1;
+    b->wrong = 0;
+    return SUD_SOLVED;
+  }
+  if (b->s->failed) {
+    return b->s->failed;
+  }
+  b->stuck = 1;
+  return SUD_UNSOLVABLE;
+}
+
+
+/********************************************************************************
+*** Builds the graph of the classic rules. Returns NULL if there's no memory.
+********************************************************************************/
+static struct graph *
+classic_graph()
+{
+  struct graph *gr;
+  if ((gr = new_graph(ROWS, COLS)) == NULL) {
+    return NULL;
+  }
+  if (!line_units(gr, 0, 0) || !box_units(gr, 0, 0) || !compile_graph(gr)) {
+    free_graph(gr);
+    return NULL;
+  }
+  return gr;
+}
+
+
+/********************************************************************************
+*** The library interface, as declared in sud.h. A sud_solver holds the rules of
+*** the classic game, its grids and the working state of the search, so nothing
+*** is shared between solvers. Everything is allocated by sud_new(), and solving
+*** just reuses it.
+********************************************************************************/
+struct sud_solver {
+  struct graph *gr;
+  struct solver *s;
+  struct grid *ig;      /* the puzzle */
+  struct grid *og;      /* its solution */
+  struct rater *rt;     /* for sud_rate() */
+};
+
+
+void
+sud_free(ss)
+  struct sud_solver *ss;
+{
+  if (ss == NULL) {
+    return;
+  }
+  free_graph(ss->gr);
+  free_solver(ss->s);
+  free(ss->ig);
+  free(ss->og);
+  free_rater(ss->rt);
+  free(ss);
+}
+
+
+struct sud_solver *
+sud_new()
+{
+  struct sud_solver *ss;
+  ss = (struct sud_solver *) calloc(1, sizeof(struct sud_solver));
+  if (ss == NULL) {
+    return NULL;
+  }
+  if (((ss->gr = classic_graph()) == NULL)
+      || ((ss->s = new_solver(ss->gr)) == NULL)
+      || ((ss->ig = new_grid(ss->gr)) == NULL) || ((ss->og = new_grid(ss->gr)) == NULL)
+      || ((ss->rt = new_rater(ss->gr)) == NULL)) {
+    sud_free(ss);
+    return NULL;
+  }
+  return ss;
+}
+
+
+/********************************************************************************
+*** The room needed for a solution line of a graph, and a NUL: format_line()
+*** writes a character a cell, or up to 4 with bigger values.
+********************************************************************************/
+static size_t
+line_size(gr)
+  struct graph *gr;
+{
+  return (MAX_VAL <= 9 ? 1 : 4) * (gr->ncells - gr->nholes) + 1;
+}
+
+
+/********************************************************************************
+*** Solves the puzzle line of n characters at in with a solver and its grids,
+*** and writes the solution line into out. Returns a SUD_ status.
+********************************************************************************/
+static int
+solve_line(s, ig, og, in, n, out, room)
+  struct solver *s;
+  struct grid *ig;
+  struct grid *og;
+  const char *in;
+  size_t n;
+  char *out;
+  size_t room;
+{
+  if (room < line_size(ig->gr)) {
+    return SUD_NO_ROOM;
+  }
+  grid_zero(ig, ig->gr);
+  if ((n > 4 * (size_t) ig->gr->ncells) || !parse_line(ig, (char *) in, (int) n)) {
+    return SUD_INVALID;
+  }
+  reset_solver(s);
+  if (!solve_grid(s, ig, og)) {
+    return s->failed ? s->failed : SUD_UNSOLVABLE;
+  }
+  out[format_line(og, out)] = '\0';
+  return SUD_SOLVED;
+}
+
+
+size_t
+sud_line_size(ss)
+  struct sud_solver *ss;
+{
+  return line_size(ss->gr);
+}
+
+
+int
+sud_solve(ss, in, n, out, room)
+  struct sud_solver *ss;
+  const char *in;
+  size_t n;
+  char *out;
+  size_t room;
+{
+  return solve_line(ss->s, ss->ig, ss->og, in, n, out, room);
+}
+
+
+int
+sud_canonical(ss, in, n, out, room)
+  struct sud_solver *ss;
+  const char *in;
+  size_t n;
+  char *out;
+  size_t room;
+{
+  struct transform t;
+  if (room < line_size(ss->gr)) {
+    return SUD_NO_ROOM;
+  }
+  grid_zero(ss->ig, ss->gr);
+  if ((n > 4 * (size_t) ss->gr->ncells) || !parse_line(ss->ig, (char *) in, (int) n)) {
+    return SUD_INVALID;
+  }
+  canonical_form(ss->s->canon, ss->ig, &t);
+  transform_grid(&t, ss->ig, ss->og, 0);
+  out[format_line(ss->og, out)] = '\0';
+  return SUD_SOLVED;
+}
+
+
+void
+sud_stats(ss, st)
+  struct sud_solver *ss;
+  struct sud_stats *st;
+{
+  st->nodes = ss->s->nodes;
+  st->guesses = ss->s->guesses;
+  st->depth = ss->s->max_depth;
+  st->dead_ends = ss->s->dead_hits;
+}
+
+
+void
+sud_set_budget(ss, b)
+  struct sud_solver *ss;
+  const struct sud_budget *b;
+{
+  if (b != NULL) ss->s->budget = *b;
+  else memset(&ss->s->budget, 0, sizeof(struct sud_budget));
+}
+
+
+void
+sud_set_cache(ss, ca)
+  struct sud_solver *ss;
+  struct sud_cache *ca;
+{
+  ss->s->cache = ca;
+}
+
+
+int
+sud_set_store(ss, p, n)
+  struct sud_solver *ss;
+  const void *p;
+  size_t n;
+{
+  long slots;
+  if (p == NULL) {
+    ss->s->store = NULL;
+    return 1;
+  }
+  if ((slots = check_store((unsigned char *) p, (long) n)) == 0) {
+    return 0;
+  }
+  ss->s->store = (unsigned char *) p + STORE_HEADER;
+  ss->s->store_slots = slots;
+  return 1;
+}
+
+
+void
+sud_cache_stats(ca, hits, misses)
+  struct sud_cache *ca;
+  long *hits;
+  long *misses;
+{
+  int k;
+  *hits = *misses = 0;
+  for (k=0; k<CACHE_SHARDS; k++) {
+    pthread_mutex_lock(&ca->shards[k].lock);
+    *hits += ca->shards[k].hits;
+    *misses += ca->shards[k].misses;
+    pthread_mutex_unlock(&ca->shards[k].lock);
+  }
+}
+
+
+void
+sud_cancel(ss)
+  struct sud_solver *ss;
+{
+  __atomic_store_n(&ss->s->cancel, 1, __ATOMIC_RELAXED);
+}
+
+
+int
+sud_count(ss, in, n, limit, count)
+  struct sud_solver *ss;
+  const char *in;
+  size_t n;
+  long limit;
+  long *count;
+{
+  *count = 0;
+  grid_zero(ss->ig, ss->gr);
+  if ((n > 4 * (size_t) ss->gr->ncells) || !parse_line(ss->ig, (char *) in, (int) n)) {
+    return SUD_INVALID;
+  }
+  reset_solver(ss->s);
+  if ((*count = count_grid(ss->s, ss->ig, ss->og, limit)) < 0) {
+    *count = ss->s->found;
+    return ss->s->failed;
+  }
+  return *count > 0 ? SUD_SOLVED : SUD_UNSOLVABLE;
+}
+
+
+int
+sud_rate(ss, in, n, rating, technique)
+  struct sud_solver *ss;
+  const char *in;
+  size_t n;
+  int *rating;
+  const char **technique;
+{
+  *rating = 0;
+  if (technique != NULL) *technique = technique_name(-1);
+  grid_zero(ss->ig, ss->gr);
+  if ((n > 4 * (size_t) ss->gr->ncells) || !parse_line(ss->ig, (char *) in, (int) n)) {
+    return SUD_INVALID;
+  }
+  switch (*rating = rate_grid(ss->rt, ss->ig)) {
+  case -1:
+    *rating = 0;
+    return SUD_UNSOLVABLE;
+  case -2:
+    *rating = 0;
+    return SUD_INVALID;
+  }
+  if (technique != NULL) *technique = technique_name(ss->rt->hardest);
+  return SUD_SOLVED;
+}
+
+
+/********************************************************************************
+*** A sud_board is a board for the classic rules, with a grid to read puzzles
+*** into. Cells are numbered as board_place() numbers them: by their place in
+*** the puzzle line, which for the classic rules is row by row.
+********************************************************************************/
+struct sud_board {
+  struct graph *gr;
+  struct board *b;
+  struct grid *ig;
+};
+
+
+void
+sud_board_free(sb)
+  struct sud_board *sb;
+{
+  if (sb == NULL) {
+    return;
+  }
+  free_board(sb->b);
+  free(sb->ig);
+  free_graph(sb->gr);
+  free(sb);
+}
+
+
+struct sud_board *
+sud_board_new()
+{
+  struct sud_board *sb;
+  if ((sb = (struct sud_board *) calloc(1, sizeof(struct sud_board))) == NULL) {
+    return NULL;
+  }
+  if (((sb->gr = classic_graph()) == NULL) || ((sb->b = new_board(sb->gr)) == NULL)
+      || ((sb->ig = new_grid(sb->gr)) == NULL)) {
+    sud_board_free(sb);
+    return NULL;
+  }
+  clear_board(sb->b);
+  return sb;
+}
+
+
+int
+sud_board_load(sb, in, n)
+  struct sud_board *sb;
+  const char *in;
+  size_t n;
+{
+  int r;
+  grid_zero(sb->ig, sb->gr);
+  if ((n > 4 * (size_t) sb->gr->ncells) || !parse_line(sb->ig, (char *) in, (int) n)) {
+    clear_board(sb->b);
+    return SUD_INVALID;
+  }
+  if ((r = board_puzzle(sb->b, sb->ig)) != SUD_SOLVED) {
+    clear_board(sb->b);
+  }
+  return r;
+}
+
+
+int
+sud_board_place(sb, cell, value)
+  struct sud_board *sb;
+  int cell,value;
+{
+  if ((cell < 0) || (cell >= sb->gr->ncells - sb->gr->nholes) || (value < 1) || (value > MAX_VAL)) {
+    return SUD_INVALID;
+  }
+  return board_place(sb->b, sb->gr->line_cell[cell], value);
+}
+
+
+int
+sud_board_erase(sb, cell)
+  struct sud_board *sb;
+  int cell;
+{
+  if ((cell < 0) || (cell >= sb->gr->ncells - sb->gr->nholes)) {
+    return SUD_INVALID;
+  }
+  return board_erase(sb->b, sb->gr->line_cell[cell]);
+}
+
+
+int
+sud_board_value(sb, cell)
+  struct sud_board *sb;
+  int cell;
+{
+  if ((cell < 0) || (cell >= sb->gr->ncells - sb->gr->nholes)) {
+    return 0;
+  }
+  return get_value(&sb->b->g->cells[sb->gr->line_cell[cell]]);
+}
+
+
+int
+sud_board_candidates(sb, cell, values)
+  struct sud_board *sb;
+  int cell;
+  int *values;
+{
+  struct cell *c;
+  int v,n;
+  if ((cell < 0) || (cell >= sb->gr->ncells - sb->gr->nholes)) {
+    return 0;
+  }
+  c = &sb->b->g->cells[sb->gr->line_cell[cell]];
+  if (c->w[0] & SOLVED) {
+    return 0;
+  }
+  if (values == NULL) {
+    return count_possibles(c);
+  }
+  for (n=0, v=1; v<=MAX_VAL; v++) {
+    if (c->w[WORD(v)] & BIT(v)) values[n++] = v;
+  }
+  return n;
+}
+
+
+int
+sud_board_solvable(sb)
+  struct sud_board *sb;
+{
+  return board_solvable(sb->b);
+}
+
+
+void
+sud_board_set_budget(sb, bu)
+  struct sud_board *sb;
+  const struct sud_budget *bu;
+{
+  if (bu != NULL) sb->b->s->budget = *bu;
+  else memset(&sb->b->s->budget, 0, sizeof(struct sud_budget));
+}
+
+
+void
+sud_board_cancel(sb)
+  struct sud_board *sb;
+{
+  __atomic_store_n(&sb->b->s->cancel, 1, __ATOMIC_RELAXED);
+}
+
+
+int
+sud_hint(ss, in, n, h)
+  struct sud_solver *ss;
+  const char *in;
+  size_t n;
+  struct sud_hint *h;
+{
+  struct rater *rt;
+  int k;
+
+  rt = ss->rt;
+  memset(h, 0, sizeof(struct sud_hint));
+  h->name = technique_name(-1);
+  h->cell = -1;
+  grid_zero(ss->ig, ss->gr);
+  if ((n > 4 * (size_t) ss->gr->ncells) || !parse_line(ss->ig, (char *) in, (int) n)) {
+    return SUD_INVALID;
+  }
+  switch (hint_grid(rt, ss->ig)) {
+  case -1: return SUD_UNSOLVABLE;
+  case -2: return SUD_INVALID;
+  }
+  if (rt->hardest < 0) {
+    return SUD_SOLVED;
+  }
+  h->name = technique_name(rt->hardest);
+  h->rating = technique_rating(rt->hardest);
+  if (rt->fill_cell >= 0) {
+    h->cell = rt->fill_cell;
+    h->value = rt->fill_value + 1;
+  }
+  /* the classic rules have no holes, so the cells of the graph are those of the line */
+  for (k=0; k<rt->nout; k++) {
+    rt->out_cand[k] <<= 1;
+  }
+  h->nremoved = rt->nout;
+  h->removed = rt->out_cell;
+  h->removed_values = rt->out_cand;
+  h->ncells = rt->nwhy;
+  h->cells = rt->why;
+  return SUD_SOLVED;
+}
+
+
+int
+sud_set_dead_ends(ss, entries)
+  struct sud_solver *ss;
+  long entries;
+{
+  return dead_ends(ss->s, ss->gr, entries);
+}
+
+
+const char *
+sud_status_text(status)
+  int status;
+{
+  switch (status) {
+  case SUD_SOLVED: return "solved";
+  case SUD_UNSOLVABLE: return "no solution";
+  case SUD_INVALID: return "invalid puzzle";
+  case SUD_NO_MEMORY: return "out of memory";
+  case SUD_NO_ROOM: return "output buffer too small";
+  case SUD_BUDGET: return "budget exceeded";
+  case SUD_CANCELLED: return "cancelled";
+  }
+  return "unknown status";
+}
+
+
+/********************************************************************************
+*** Asynchronous solving. A pool of worker threads, each with a solver and grids
+*** of its own, takes puzzles from a queue in the order they were submitted. The
+*** result of each goes to the callback given with it, called on the worker's
+*** thread, or else onto a completion queue for sud_poll() and sud_wait(). An
+*** eventfd counts the results waiting on the completion queue, so it's readable
+*** exactly when there is one to poll, and a caller can watch it with epoll.
+*** Jobs are kept on a free list and reused, so once a pool has had as many in
+*** flight as it ever will, submitting allocates nothing either.
+********************************************************************************/
+struct sud_job {
+  struct sud_job *next;
+  long ticket;
+  char *in;             /* a copy of the puzzle line, */
+  size_t n;             /* its length, */
+  size_t in_room;       /* and the room for it */
+  char *out;            /* where the solution goes */
+  size_t room;
+  sud_callback cb;      /* who to tell, or NULL for the completion queue */
+  void *arg;
+  int status;
+};
+
+struct worker {
+  pthread_t thread;
+  struct sud_pool *pool;
+  struct solver *s;
+  struct grid *ig;
+  struct grid *og;
+};
+
+struct sud_pool {
+  pthread_mutex_t lock;
+  pthread_cond_t work;            /* signalled when a job is submitted */
+  pthread_cond_t done;            /* signalled when a result is queued */
+  struct graph *gr;               /* the rules, shared by the workers */
+  struct worker *workers;
+  int nworkers;
+  struct sud_job *todo,*todo_last;  /* jobs waiting for a worker, in order */
+  struct sud_job *results,*results_last;  /* results waiting to be polled */
+  struct sud_job *spare;          /* jobs to reuse */
+  long tickets;                   /* the last ticket given out */
+  long owed;                      /* results still to come to the queue */
+  int efd;                        /* the eventfd counting the results waiting */
+  struct sud_budget budget;       /* for each puzzle */
+  struct sud_cache *cache;        /* for the workers to share, if any */
+  unsigned char *store;           /* and the table of a solution store */
+  long store_slots;
+  int stop;                       /* set when the pool is being freed */
+};
+
+
+/********************************************************************************
+*** A worker thread: solves jobs until the pool is freed.
+********************************************************************************/
+static void *
+pool_worker(arg)
+  void *arg;
+{
+  struct worker *w;
+  struct sud_pool *p;
+  struct sud_job *j;
+  unsigned long long one;
+
+  w = (struct worker *) arg;
+  p = w->pool;
+  one = 1;
+  pthread_mutex_lock(&p->lock);
+  for (;;) {
+    while ((p->todo == NULL) && !p->stop) {
+      pthread_cond_wait(&p->work, &p->lock);
+    }
+    if (p->stop) break;
+    j = p->todo;
+    p->todo = j->next;
+    w->s->budget = p->budget;
+    w->s->cache = p->cache;
+    w->s->store = p->store;
+    w->s->store_slots = p->store_slots;
+    pthread_mutex_unlock(&p->lock);
+
+    j->status = solve_line(w->s, w->ig, w->og, j->in, j->n, j->out, j->room);
+    if (j->cb != NULL) {
+      (*j->cb)(j->ticket, j->status, j->arg);
+    }
+
+    pthread_mutex_lock(&p->lock);
+    if (j->cb != NULL) {
+      j->next = p->spare;
+      p->spare = j;
+    }
+    else {
+      j->next = NULL;
+      if (p->results == NULL) p->results = j;
+      else p->results_last->next = j;
+      p->results_last = j;
+      write(p->efd, &one, sizeof(one));
+      pthread_cond_broadcast(&p->done);
+    }
+  }
+  pthread_mutex_unlock(&p->lock);
+  return NULL;
+}
+
+
+void
+sud_pool_free(p)
+  struct sud_pool *p;
+{
+  struct sud_job *j,*lists[3];
+  int k;
+
+  if (p == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&p->lock);
+  p->stop = 1;
+  pthread_cond_broadcast(&p->work);
+  pthread_mutex_unlock(&p->lock);
+  /* don't wait for puzzles being solved */
+  for (k=0; k<p->nworkers; k++) {
+    __atomic_store_n(&p->workers[k].s->cancel, 1, __ATOMIC_RELAXED);
+  }
+  for (k=0; k<p->nworkers; k++) {
+    pthread_join(p->workers[k].thread, NULL);
+    free_solver(p->workers[k].s);
+    free(p->workers[k].ig);
+    free(p->workers[k].og);
+  }
+  lists[0] = p->todo;
+  lists[1] = p->results;
+  lists[2] = p->spare;
+  for (k=0; k<3; k++) {
+    while ((j = lists[k]) != NULL) {
+      lists[k] = j->next;
+      free(j->in);
+      free(j);
+    }
+  }
+  if (p->efd >= 0) close(p->efd);
+  pthread_cond_destroy(&p->work);
+  pthread_cond_destroy(&p->done);
+  pthread_mutex_destroy(&p->lock);
+  free(p->workers);
+  free_graph(p->gr);
+  free(p);
+}
+
+
+struct sud_pool *
+sud_pool_new(threads)
+  int threads;
+{
+  struct sud_pool *p;
+  struct worker *w;
+  int k;
+
+  if (threads < 1) {
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) threads = 1;
+  }
+  if ((p = (struct sud_pool *) calloc(1, sizeof(struct sud_pool))) == NULL) {
+    return NULL;
+  }
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->work, NULL);
+  pthread_cond_init(&p->done, NULL);
+  p->efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK | EFD_SEMAPHORE);
+  p->workers = (struct worker *) calloc(threads, sizeof(struct worker));
+  if ((p->efd < 0) || (p->workers == NULL) || ((p->gr = classic_graph()) == NULL)) {
+    sud_pool_free(p);
+    return NULL;
+  }
+  for (k=0; k<threads; k++) {
+    w = &p->workers[k];
+    w->pool = p;
+    if (((w->s = new_solver(p->gr)) == NULL)
+        || ((w->ig = new_grid(p->gr)) == NULL) || ((w->og = new_grid(p->gr)) == NULL)
+        || (pthread_create(&w->thread, NULL, pool_worker, (void *) w) != 0)) {
+      free_solver(w->s);
+      free(w->ig);
+      free(w->og);
+      sud_pool_free(p);
+      return NULL;
+    }
+    p->nworkers++;
+  }
+  return p;
+}
+
+
+long
+sud_submit(p, in, n, out, room, cb, arg)
+  struct sud_pool *p;
+  const char *in;
+  size_t n;
+  char *out;
+  size_t room;
+  sud_callback cb;
+  void *arg;
+{
+  struct sud_job *j;
+  char *copy;
+
+  pthread_mutex_lock(&p->lock);
+  if ((j = p->spare) != NULL) {
+    p->spare = j->next;
+  }
+  pthread_mutex_unlock(&p->lock);
+  if ((j == NULL) && ((j = (struct sud_job *) calloc(1, sizeof(struct sud_job))) == NULL)) {
+    return -1;
+  }
+  if (n > j->in_room) {
+    if ((copy = (char *) realloc(j->in, n)) == NULL) {
+      free(j->in);
+      free(j);
+      return -1;
+    }
+    j->in = copy;
+    j->in_room = n;
+  }
+  memcpy(j->in, in, n);
+  j->n = n;
+  j->out = out;
+  j->room = room;
+  j->cb = cb;
+  j->arg = arg;
+  j->next = NULL;
+
+  pthread_mutex_lock(&p->lock);
+  j->ticket = ++p->tickets;
+  if (cb == NULL) p->owed++;
+  if (p->todo == NULL) p->todo = j;
+  else p->todo_last->next = j;
+  p->todo_last = j;
+  pthread_cond_signal(&p->work);
+  pthread_mutex_unlock(&p->lock);
+  return j->ticket;
+}
+
+
+/********************************************************************************
+*** Takes the next result off the completion queue, waiting for one if asked
+*** to and any are still to come. Returns 1 if it took one, 0 if not.
+********************************************************************************/
+static int
+take_result(p, r, wait)
+  struct sud_pool *p;
+  struct sud_result *r;
+  int wait;
+{
+  struct sud_job *j;
+  unsigned long long count;
+
+  pthread_mutex_lock(&p->lock);
+  while (wait && (p->results == NULL) && (p->owed > 0)) {
+    pthread_cond_wait(&p->done, &p->lock);
+  }
+  if ((j = p->results) == NULL) {
+    pthread_mutex_unlock(&p->lock);
+    return 0;
+  }
+  p->results = j->next;
+  p->owed--;
+  read(p->efd, &count, sizeof(count));
+  r->ticket = j->ticket;
+  r->status = j->status;
+  r->arg = j->arg;
+  j->next = p->spare;
+  p->spare = j;
+  pthread_mutex_unlock(&p->lock);
+  return 1;
+}
+
+
+int
+sud_poll(p, r)
+  struct sud_pool *p;
+  struct sud_result *r;
+{
+  return take_result(p, r, 0);
+}
+
+
+int
+sud_wait(p, r)
+  struct sud_pool *p;
+  struct sud_result *r;
+{
+  return take_result(p, r, 1);
+}
+
+
+void
+sud_pool_budget(p, b)
+  struct sud_pool *p;
+  const struct sud_budget *b;
+{
+  pthread_mutex_lock(&p->lock);
+  if (b != NULL) p->budget = *b;
+  else memset(&p->budget, 0, sizeof(struct sud_budget));
+  pthread_mutex_unlock(&p->lock);
+}
+
+
+void
+sud_pool_cache(p, ca)
+  struct sud_pool *p;
+  struct sud_cache *ca;
+{
+  pthread_mutex_lock(&p->lock);
+  p->cache = ca;
+  pthread_mutex_unlock(&p->lock);
+}
+
+
+int
+sud_pool_store(p, q, n)
+  struct sud_pool *p;
+  const void *q;
+  size_t n;
+{
+  long slots;
+  slots = 0;
+  if ((q != NULL) && ((slots = check_store((unsigned char *) q, (long) n)) == 0)) {
+    return 0;
+  }
+  pthread_mutex_lock(&p->lock);
+  p->store = q != NULL ? (unsigned char *) q + STORE_HEADER : NULL;
+  p->store_slots = slots;
+  pthread_mutex_unlock(&p->lock);
+  return 1;
+}
+
+
+int
+sud_pool_fd(p)
+  struct sud_pool *p;
+{
+  return p->efd;
+}
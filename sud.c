@@ -2,420 +2,2758 @@
 *** Sudoku solver written in K&R C.
 *** Copyright 2021 Adam Jaworski.
 *** MIT License
+***
+*** This is the sud program: reading puzzles and descriptions, writing results
+*** and running batches. The solving is done by the engine in libsud.c.
+***
+*** Build with: cc -O2 -pthread -o sud sud.c
+*** and for compressed batches add -DWITH_ZLIB -lz and/or -DWITH_ZSTD -lzstd.
+***
+*** The puzzles s1.txt and s2.txt are solved with sud s1.txt. The batch l1.txt
+*** has the same two and others, hard, unsolvable or unreadable, and comes with
+*** what each way of running it should write:
+***   sud -l l1.txt                       l1.out
+***   sud -l -j 4 l1.txt                  l1.out
+***   sud -l -b 200 l1.txt                l1-budget.out
+***   sud -l -o pack l1.txt               l1.pack
+***   sud -k l1.txt                       l1-canon.out
+***   sud -l -a new.store l1.txt          l1.out, and new.store as l1.store
+***   sud -l -s l1.store l1.txt           l1.out
+*** and sud -g 10 -r 1 -o line should write the puzzles in g1.out.
+*** Each variant has a description, a batch of puzzles and what it should write:
+***   sud -l -d x.desc x.txt              x.out
+***   sud -l -d windoku.desc windoku.txt  windoku.out
+***   sud -l -d jigsaw.desc jigsaw.txt    jigsaw.out
+***   sud -l -d killer.desc killer.txt    killer.out
+***   sud -l -d samurai.desc samurai.txt  samurai.out
+*** The walk the generator makes its grids with is checked by test_walk.c, and
+*** the C++ front end sud.hpp against l1.out and l1-budget.out by test_hpp.cpp.
+*** The interface of sud.h is checked against known answers by test_api.c.
 ********************************************************************************/
 
 
 /* Standard library header files needed on all but the most ancient systems. */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef WITH_ZSTD
+#include <zstd.h>
+#endif
+
+/* the engine, built into the program as part of the same unit, with the parts
+** of it that only the program uses */
+#define SUD_PROGRAM
+#include "libsud.c"
 
-#define ROWS 9
-#define COLS 9
-#define R_ROWS 3               /* region rows */
-#define R_COLS 3               /* region columns */
-#define MAX_VAL 9
-#define O_CELL 1022            /* 0b1111111110 open cell with nothing in it */
-#define H_LINE " ------- ------- ------- "   /* horizontal line used when printing output */
-#define SOLVED 1               /* bit 0 in a cell is a flag to indicate if a it is solved */
 
 /********************************************************************************
-*** Possible values in a cell are indicated as a bit field within an integer value type.
-*** so the cell value 0b1111111110 indicates
-***                     987654321U the solutions 1-9 are available and the cell is unsolved(U).
-*** whereas the value 0b1000010000 indicates
-***                     9----4---U the solutions 9 and 4 are possible for this unsolved cell,
-*** and the value     0b0000001001 indicates
-***                     ------3--S that the cell is solved(S) with the solution 3. 
+*** Reads the rest of a description line as a list of cells, written r1c1 for
+*** row 1 column 1. Returns the number of cells, or -1 if the list is bad.
 ********************************************************************************/
-
-
-/* the data structure that holds the 'state' of a solved or unsolved sudoku game */
-struct grid { int cells[ROWS][COLS]; int solved_counter; };
+int
+read_cells(gr, cells)
+  struct graph *gr;
+  int *cells;          /* room for MAX_VAL cells */
+{
+  char *word;
+  int n,r,c,len;
+  n = 0;
+  while ((word = strtok(NULL, " \t\r\n")) != NULL) {
+    if ((sscanf(word, "r%dc%d%n", &r, &c, &len) != 2) || (word[len] != '\0')
+        || (r < 1) || (r > gr->rows) || (c < 1) || (c > gr->cols)
+        || (n == MAX_VAL)) {
+      return -1;
+    }
+    cells[n++] = (r-1)*gr->cols + c-1;
+  }
+  return n;
+}
 
 
 /********************************************************************************
-*** Initialise a solution grid with all values available in all cells.
+*** Reads a puzzle description into an empty graph. The puzzle is one or more
+*** classic sized grids, whose rows and columns are always units, and each line
+*** of the description adds more:
+***   size 21 21      the layout is 21 rows by 21 columns, rather than the size
+***                   of a single grid
+***   grid r1c13      there's a grid with its top left cell at row 1 column 13;
+***                   several overlapping grids share the cells they have in
+***                   common (samurai). With no grid lines there's one grid
+***                   filling the layout
+***   boxes           the classic R_ROWS x R_COLS regions, in every grid
+***   diagonals       the two main diagonals of every grid (X-sudoku)
+***   windows         the extra windows of windoku, in every grid
+***   regions         irregular (jigsaw) regions, given on the following lines as
+***                   a map of the layout with one character per cell, cells with
+***                   the same character being in the same region and dots
+***                   being in none
+***   unit r1c1 r1c2  any other group of cells that must all be different
+***   cage 12 r1c1 r1c2
+***                   a killer cage, cells that are all different and add up
+***                   to the given sum
+*** Size and grid lines come before the others. Blank lines and lines starting
+*** with # are ignored.
+*** Returns boolean success or failure.
 ********************************************************************************/
-struct grid *
-grid_zero(g)
-  struct grid *g;
+int
+read_description(gr, f)
+  struct graph *gr;
+  FILE *f;
 {
-  int i,j;
-  for (i=0; i<ROWS; i++) {
-    for (j=0; j<COLS; j++) {
-      g->cells[i][j] = O_CELL;
+  char line[8192];
+  char *word;
+  int cells[MAX_VAL];
+  int grid_cell[MAX_GRIDS];   /* top left cell of each grid */
+  int ngrids;
+  int *region;
+  int i,j,k,n,r,c,len;
+
+  ngrids = 0;
+  while (1) {
+    if (fgets(line, sizeof(line), f) == NULL) {
+      word = NULL;
+    }
+    else if (((word = strtok(line, " \t\r\n")) == NULL) || (word[0] == '#')) {
+      continue;
+    }
+    else if (strcmp(word, "size") == 0) {
+      if ((gr->nunits > 0) || (ngrids > 0)
+          || ((word = strtok(NULL, " \t\r\n")) == NULL) || (sscanf(word, "%d", &r) != 1)
+          || ((word = strtok(NULL, " \t\r\n")) == NULL) || (sscanf(word, "%d", &c) != 1)
+          || (r < ROWS) || (c < COLS)) {
+        return 0;
+      }
+      gr->rows = r;
+      gr->cols = c;
+      gr->ncells = r*c;
+      continue;
+    }
+    else if (strcmp(word, "grid") == 0) {
+      if ((ngrids == MAX_GRIDS) || (gr->nunits > 0)
+          || (read_cells(gr, cells) != 1)
+          || (cells[0]/gr->cols + ROWS > gr->rows) || (cells[0]%gr->cols + COLS > gr->cols)) {
+        return 0;
+      }
+      grid_cell[ngrids++] = cells[0];
+      continue;
+    }
+
+    if (gr->nunits == 0) {
+      /* the grids are settled, so put in their rows and columns */
+      if (ngrids == 0) {
+        grid_cell[ngrids++] = 0;
+      }
+      for (k=0; k<ngrids; k++) {
+        if (!line_units(gr, grid_cell[k]/gr->cols, grid_cell[k]%gr->cols)) return 0;
+      }
+    }
+    if (word == NULL) {
+      /* end of the description */
+      break;
+    }
+    if (strcmp(word, "boxes") == 0) {
+      for (k=0; k<ngrids; k++) {
+        if (!box_units(gr, grid_cell[k]/gr->cols, grid_cell[k]%gr->cols)) return 0;
+      }
+    }
+    else if (strcmp(word, "diagonals") == 0) {
+      for (k=0; k<ngrids; k++) {
+        if (!diagonal_units(gr, grid_cell[k]/gr->cols, grid_cell[k]%gr->cols)) return 0;
+      }
+    }
+    else if (strcmp(word, "windows") == 0) {
+      for (k=0; k<ngrids; k++) {
+        if (!window_units(gr, grid_cell[k]/gr->cols, grid_cell[k]%gr->cols)) return 0;
+      }
+    }
+    else if (strcmp(word, "regions") == 0) {
+      /* note the region of every cell, by its character in the map */
+      region = (int *) malloc(gr->ncells * sizeof(int));
+      if (region == NULL) return 0;
+      for (i=0; i<gr->ncells; i++) {
+        region[i] = -1;
+      }
+      for (i=0; i<gr->rows; i++) {
+        if (fgets(line, sizeof(line), f) == NULL) {
+          free(region);
+          return 0;
+        }
+        for (j=0, k=0; line[k] && (line[k] != '\n') && (line[k] != '\r'); k++) {
+          if ((line[k] == ' ') || (line[k] == '\t')) continue;
+          if (j == gr->cols) break;
+          if (line[k] == '.') j++;
+          else region[i*gr->cols + j++] = (unsigned char) line[k];
+        }
+        if (j != gr->cols) {
+          free(region);
+          return 0;
+        }
+      }
+      /* and add a unit for each different character */
+      for (k=0; k<gr->ncells; k++) {
+        if (region[k] == -1) continue;
+        r = region[k];
+        for (i=k, n=0; i<gr->ncells; i++) {
+          if (region[i] != r) continue;
+          if (n == MAX_VAL) {
+            free(region);
+            return 0;
+          }
+          cells[n++] = i;
+          region[i] = -1;
+        }
+        if (!add_unit(gr, cells, n)) {
+          free(region);
+          return 0;
+        }
+      }
+      free(region);
+    }
+    else if (strcmp(word, "unit") == 0) {
+      if ((n = read_cells(gr, cells)) == -1) return 0;
+      if (!add_unit(gr, cells, n)) return 0;
+    }
+    else if (strcmp(word, "cage") == 0) {
+      word = strtok(NULL, " \t\r\n");
+      if ((word == NULL) || (sscanf(word, "%d%n", &k, &len) != 1) || (word[len] != '\0')) {
+        return 0;
+      }
+      if ((n = read_cells(gr, cells)) == -1) return 0;
+      if (!add_cage(gr, cells, n, k)) return 0;
+    }
+    else {
+      /* something was wrong with the description, signal error */
+      return 0;
     }
   }
-  g->solved_counter = 0;
-  return g;
+  return 1;
 }
 
 
 /********************************************************************************
-*** Make an exact copy of game state from one grid to another.
+*** Reads a grid of clues from standard input.
+*** Expects numbers for each cell horizontally, space or hyphen (-) for unknown
+*** and new line for next row.
+*** Grids with more than 9 values are read as whitespace separated numbers
+*** instead, with a hyphen (-), dot (.) or 0 for unknown.
+*** Holes in the layout of the puzzle are read like unknown cells.
 ********************************************************************************/
+#if MAX_VAL <= 9
 int
-copy_grid(sg, dg)
-  struct grid *sg;
-  struct grid *dg;
+read_grid(g)
+  struct grid *g;
 {
+  char in;
   int i,j;
-  for (i=0; i<ROWS; i++) {
-    for (j=0; j<COLS; j++) {
-      dg->cells[i][j] = sg->cells[i][j];
+  struct graph *gr;
+  gr = g->gr;
+  for (i=0; i<gr->rows; i++) {
+    j=0;
+    while ((in = getchar())) {
+      if (in == '\n') {
+        /* advance to next row */
+        break;
+      } 
+      else if ((in == ' ') || (in == '-') || (j>=gr->cols)) {
+        /* advance to next column */
+        j++;
+      }
+      else if ((in >= '1') && (in <= '9') && !gr->hole[i*gr->cols + j]) {
+        /* enter clue into the correct column of the starting grid */
+        set_value(&g->cells[i*gr->cols + j], in - '0');
+      	g->solved_counter++;
+        j++;
+      }
+      else {
+      	/* something was wrong with the input, signal error */
+      	return 0;
+      }
+    }
+  }
+  return 1;
+}
+#else
+int
+read_grid(g)
+  struct grid *g;
+{
+  int in;
+  int i,v,blank;
+  for (i=0; i<g->gr->ncells; i++) {
+    {
+      /* skip whitespace before the next cell */
+      while ((in = getchar()) == ' ' || in == '\t' || in == '\n' || in == '\r');
+      v = 0;
+      blank = (in == '-') || (in == '.');
+      if (blank) {
+        in = getchar();
+      }
+      else {
+        while ((in >= '0') && (in <= '9')) {
+          v = v*10 + in - '0';
+          in = getchar();
+        }
+      }
+      if ((in != EOF) && (in != ' ') && (in != '\t') && (in != '\n') && (in != '\r')) {
+        /* something was wrong with the input, signal error */
+        return 0;
+      }
+      if ((v > MAX_VAL) || ((v > 0) && g->gr->hole[i])) {
+        return 0;
+      }
+      if (v > 0) {
+        set_value(&g->cells[i], v);
+        g->solved_counter++;
+      }
+      else if (!blank && (in == EOF)) {
+        /* ran out of input */
+        return 0;
+      }
     }
   }
-  dg->solved_counter = sg->solved_counter;
+  return 1;
 }
+#endif
+
+
+/********************************************************************************
+*** Output. Everything we write goes into one big buffer, which is handed over
+*** with a single write() when it fills up or when we're done, rather than a
+*** stdio call for every cell. A solution can be written as a pretty grid, as a
+*** line in the format read by parse_line(), as CSV: the input line, a comma
+*** and the solution line, or as a packed record after a packed header. Or the
+*** solution can be left out for a rating of the puzzle: the input line, then
+*** how hard it is for a person and the hardest technique it needs, as CSV.
+*** The output can be compressed with gzip or zstd on its way out, a buffer full
+*** at a time, in builds with the library.
+********************************************************************************/
+#define OUT_GRID 0
+#define OUT_LINE 1
+#define OUT_CSV 2
+#define OUT_PACK 3
+#define OUT_RATE 4
+#define OUT_BUFFER (1<<20)
+#define ZIP_NONE 0
+#define ZIP_GZIP 1
+#define ZIP_ZSTD 2
+#define ZIP_OUT (1<<16)        /* compressed output goes out this much at a time */
 
+struct output {
+  int fd;              /* where the output goes */
+  int format;          /* OUT_GRID, OUT_LINE, OUT_CSV, OUT_PACK or OUT_RATE */
+  int zip;             /* ZIP_NONE, ZIP_GZIP or ZIP_ZSTD */
+  char *zs;            /* the compression stream */
+  int failed;          /* set if a write has failed */
+  long len;            /* number of characters waiting in the buffer */
+  long room;           /* size of the buffer */
+  char *buf;
+  struct rater *rater; /* for OUT_RATE, made when first needed */
+};
 
 
 /********************************************************************************
-*** Setter and getter functions for individual cells.
+*** Makes an output for a file descriptor, with a buffer of room characters.
+*** Returns NULL if there's no memory.
 ********************************************************************************/
-int
-set_value(value)
-  int value;
+struct output *
+new_output(fd, format, room)
+  int fd,format;
+  long room;
 {
-  return 1<<value | SOLVED;
+  struct output *o;
+  o = (struct output *) malloc(sizeof(struct output) + room);
+  if (o == NULL) {
+    return NULL;
+  }
+  o->buf = (char *) (o + 1);
+  o->room = room;
+  o->fd = fd;
+  o->format = format;
+  o->zip = ZIP_NONE;
+  o->zs = NULL;
+  o->failed = 0;
+  o->len = 0;
+  o->rater = NULL;
+  return o;
 }
 
+
+/********************************************************************************
+*** Writes all n characters at p to a file descriptor.
+*** Returns boolean success or failure.
+********************************************************************************/
 int
-get_value(cell)
-  int cell;
+write_all(fd, p, n)
+  int fd;
+  char *p;
+  long n;
 {
-  int i;
-  i=0;   /* returns 0 if unsolved */
-  if (cell & SOLVED) {
-    /* solved */
-    for (i=1; i<=MAX_VAL; i++) {
-      if (cell & 1<<i) break;
+  long done;
+  int got;
+  for (done=0; done<n; done+=got) {
+    if ((got = write(fd, p + done, n - done)) <= 0) {
+      return 0;
     }
   }
-  return i;
+  return 1;
 }
- 
+
 
 /********************************************************************************
-*** Set solved flag if the cell is solved (has only one possible value).
+*** Sets an output to compress everything written to it from now on.
+*** Returns boolean success or failure (of memory, or if the build can't).
 ********************************************************************************/
 int
-mark_if_solved(cell)
-  int cell;
+out_zip(o, zip)
+  struct output *o;
+  int zip;             /* ZIP_GZIP or ZIP_ZSTD */
 {
-  int poss;
-  int i;
-  poss = 0;
-  for (i=1; i<=MAX_VAL; i++) {
-    if (cell & (1<<i)) poss++;
+#ifdef WITH_ZLIB
+  z_stream *z;
+  if (zip == ZIP_GZIP) {
+    if ((z = (z_stream *) calloc(1, sizeof(z_stream))) == NULL) {
+      return 0;
+    }
+    /* 16 more window bits asks for a gzip header */
+    if (deflateInit2(z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+      free(z);
+      return 0;
+    }
+    o->zs = (char *) z;
+    o->zip = zip;
+    return 1;
+  }
+#endif
+#ifdef WITH_ZSTD
+  if (zip == ZIP_ZSTD) {
+    if ((o->zs = (char *) ZSTD_createCCtx()) == NULL) {
+      return 0;
+    }
+    o->zip = zip;
+    return 1;
   }
-  if (poss == 1) cell = cell | SOLVED;
-  return cell;
+#endif
+#if !defined(WITH_ZLIB) && !defined(WITH_ZSTD)
+  (void) o;
+  (void) zip;
+#endif
+  return 0;
 }
 
- 
+
 /********************************************************************************
-*** Where we have a solved cell, this helper function will clear this value from
-*** connected cells in the current row, column or region of the source cell.
-*** Returns the number of cell changes it made, or -1 if the grid is invalid
-*** (ie at least one cell is wiped out with no possible solution).
+*** Compresses everything in the buffer and writes out what comes of it. If end
+*** is set this is the last of the output, and the compressed stream is closed.
+*** Returns boolean success or failure.
 ********************************************************************************/
 int
-reduce(g, row, column)
-  struct grid *g;
-  int row,column;
+zip_flush(o, end)
+  struct output *o;
+  int end;
 {
-  int source_cell;
-  int mask;
-  int changed;
-  int i,j;
-  int *cell, cell_prev;
+#if defined(WITH_ZLIB) || defined(WITH_ZSTD)
+  char out[ZIP_OUT];
+  int more;
+#endif
+#ifdef WITH_ZLIB
+  z_stream *z;
+#endif
+#ifdef WITH_ZSTD
+  ZSTD_inBuffer zin;
+  ZSTD_outBuffer zout;
+  size_t r;
+#endif
+#if !defined(WITH_ZLIB) && !defined(WITH_ZSTD)
+  (void) end;
+#endif
 
-  source_cell = g->cells[row][column];
-  
-  /* return immediately if the source cell is not already solved */
-  if ((source_cell & SOLVED) == 0) {
-    return 0;
+  switch (o->zip) {
+#ifdef WITH_ZLIB
+  case ZIP_GZIP:
+    z = (z_stream *) o->zs;
+    z->next_in = (Bytef *) o->buf;
+    z->avail_in = o->len;
+    do {
+      z->next_out = (Bytef *) out;
+      z->avail_out = ZIP_OUT;
+      more = deflate(z, end ? Z_FINISH : Z_NO_FLUSH) == Z_OK;
+      if (!write_all(o->fd, out, (long) (ZIP_OUT - z->avail_out))) {
+        return 0;
+      }
+    } while (more && ((z->avail_in > 0) || (z->avail_out == 0) || end));
+    return 1;
+#endif
+#ifdef WITH_ZSTD
+  case ZIP_ZSTD:
+    zin.src = o->buf;
+    zin.size = o->len;
+    zin.pos = 0;
+    do {
+      zout.dst = out;
+      zout.size = ZIP_OUT;
+      zout.pos = 0;
+      r = ZSTD_compressStream2((ZSTD_CCtx *) o->zs, &zout, &zin, end ? ZSTD_e_end : ZSTD_e_continue);
+      if (ZSTD_isError(r) || !write_all(o->fd, out, (long) zout.pos)) {
+        return 0;
+      }
+      more = end ? r > 0 : zin.pos < zin.size;
+    } while (more);
+    return 1;
+#endif
   }
+  return 0;
+}
 
-  mask = ~(source_cell & O_CELL);  /* could be simply ~source_cell */
-  changed = 0;
-  for (i=0; i<ROWS; i++) {
-    for (j=0; j<COLS; j++) {
-
-      /* pointer to a target cell */
-      cell = &g->cells[i][j];
-
-      /* skip over the source cell */
-      if (((i==row) && (j==column))) continue;
-
-      /* change unsolved cell possibles if they are on the same row, column or region 
-      ** as the source cell AND contain the source value as a possible value */
-      if (((i==row) || 
-           (j==column) ||
-           ((row/R_ROWS == i/R_ROWS) && (column/R_COLS == j/R_COLS))) 
-           && (*cell & mask)) {
-        cell_prev = *cell;
-        *cell = mark_if_solved(*cell & mask);
-
-        /* if we cleared any possibles, increment the changed counter */
-        if (*cell != cell_prev) {
-          changed++; 
-          /* and if we have solved a cell, increment the solved cells counter */
-          if (*cell & SOLVED) {
-            g->solved_counter++;
-          }
-        }
 
-        /* if a cell is invalid (has no possible solutions) exit function straightaway */
-	if ((*cell == 0) || (*cell == 1)) {
-          /* -1 signals to calling function that this grid is invalid */
-          return -1;
-        }
-      } 
-    } 
+/********************************************************************************
+*** Writes out everything in the buffer. Returns boolean success or failure
+*** (of this or any earlier write).
+********************************************************************************/
+int
+out_flush(o)
+  struct output *o;
+{
+  if (!(o->zip == ZIP_NONE ? write_all(o->fd, o->buf, o->len) : zip_flush(o, 0))) {
+    o->failed = 1;
   }
-  /* return the number of possibles we cleared */
-  return changed;
+  o->len = 0;
+  return !o->failed;
 }
 
 
 /********************************************************************************
-*** Uses reduce() to remove possible values from unsolved cells.
-*** Checks every cell in a grid.
+*** Writes out everything in the buffer for the last time, closing the stream
+*** if it's compressed. Returns boolean success or failure.
 ********************************************************************************/
 int
-reduce_grid(g)
-  struct grid *g;
+out_close(o)
+  struct output *o;
 {
-  int i,j;
-  int r,reductions;
-  r = 0;
-  reductions = 0;
-  /* iterate through every cell */
-  for (i=0; i<ROWS; i++) {
-    for (j=0; j<COLS; j++) {
-      /* the reduce() function removes solved cells from possible solutions in
-      ** unsolved cells in the grid */
-      r = reduce(g,i,j);
-      if (r == -1) {
-        /* return early if we have an unsolveable cell */
-        return -1;
-      }
-      reductions = reductions + r;
-    }
+  if ((o->zip != ZIP_NONE) && !zip_flush(o, 1)) {
+    o->failed = 1;
   }
-  return reductions; 
+  else if (o->zip == ZIP_NONE) {
+    out_flush(o);
+  }
+#ifdef WITH_ZLIB
+  if (o->zip == ZIP_GZIP) {
+    deflateEnd((z_stream *) o->zs);
+    free(o->zs);
+  }
+#endif
+#ifdef WITH_ZSTD
+  if (o->zip == ZIP_ZSTD) ZSTD_freeCCtx((ZSTD_CCtx *) o->zs);
+#endif
+  o->zip = ZIP_NONE;
+  o->zs = NULL;
+  o->len = 0;
+  free_rater(o->rater);
+  o->rater = NULL;
+  return !o->failed;
 }
 
 
 /********************************************************************************
-*** Chooses a cell with the lowest number of possible answers
-*** to help optimise the computation (ie find the right answer earlier).
-*** Checks every cell in the grid to find out how many possible answers each cell
-*** has and picks the one with the lowest number of possibles.
-*** Obvs. skips cells that are already solved
+*** Frees an output, once closed if it's written to a file.
 ********************************************************************************/
-int
-choose_target_cell(g,r,c)
-  struct grid *g;
-  int *r,*c;
-{
-  int i,j,k;  /* current row and column, and k is the possible value iterator */
-  int tr,tc;  /* row and column of best target found so far */
-  int a,t;    /* a is number of possibles of current cell, t is the number of possibles
-                 for best target so far */
-  t=MAX_VAL;  /* initialise t to a high number */
-  tr=0; tc=0;
-  for (i=0; i<ROWS; i++) {
-    for (j=0; j<COLS; j++) {
-      if (g->cells[i][j] & SOLVED) {
-        /* jump over this cell if it's already been solved */
-        continue;
-      }
-      /* figure out how many answers currently possible for this cell */
-      a=0;
-      for (k=1; k<=MAX_VAL; k++) {
-        if (1<<k & g->cells[i][j]) {
-          a++;
-        }
-      }
-      if (a<t) {
-        /* if we've got a cell with a lower number of possible answers than we found
-        ** so far, make this the target cell */
-        t = a;
-        tr = i;
-        tc = j;
-      }
-    }
+void
+free_output(o)
+  struct output *o;
+{
+  if (o != NULL) {
+    free_rater(o->rater);
+    free(o);
   }
-  /* return the best target cell we found */
-  *r = tr;
-  *c = tc;
 }
 
 
 /********************************************************************************
-*** Reads a grid of clues from standard input.
-*** Expects numbers for each cell horizontally, space or hyphen (-) for unknown
-*** and new line for next row.
+*** Makes sure there is room for n more characters in the buffer, and returns
+*** where they go. Whoever fills them in moves o->len on.
 ********************************************************************************/
-int
-read_grid(g)
-  struct grid *g;
+char *
+out_room(o, n)
+  struct output *o;
+  long n;
 {
-  char in;
-  int i,j;
-  for (i=0; i<ROWS; i++) {
-    j=0;
-    while ((in = getchar())) {
-      if (in == '\n') {
-        /* advance to next row */
-        break;
-      } 
-      else if ((in == ' ') || (in == '-') || (j>=COLS)) {
-        /* advance to next column */
-        j++;
-      }
-      else if ((in >= '1') && (in <= '9')) {
-        /* enter clue into the correct column of the starting grid */
-        /* g->cells[i][j] = set_value((int) (in - '0')); */
-        g->cells[i][j] = set_value(in - '0');
-      	g->solved_counter++;
-        j++;
-      }
-      else {
-      	/* something was wrong with the input, signal error */
-      	return 0;
-      }
-    }
+  if (o->len + n > o->room) {
+    out_flush(o);
   }
-  return 1;
+  return o->buf + o->len;
+}
+
+
+/********************************************************************************
+*** Adds n characters of text, or a string if n is -1.
+********************************************************************************/
+void
+out_text(o, text, n)
+  struct output *o;
+  char *text;
+  long n;
+{
+  long m;
+  if (n == -1) {
+    n = strlen(text);
+  }
+  /* anything bigger than the buffer goes out a buffer full at a time */
+  while (o->len + n > o->room) {
+    m = o->room - o->len;
+    memcpy(o->buf + o->len, text, m);
+    o->len += m;
+    text += m;
+    n -= m;
+    out_flush(o);
+  }
+  memcpy(o->buf + o->len, text, n);
+  o->len += n;
 }
 
 
 /********************************************************************************
 *** Displays the contents of a sudoku grid 
 ********************************************************************************/
-int
-print_grid(g)
+void
+print_line(o, gr, width)
+  struct output *o;
+  struct graph *gr;
+  int width;
+{
+  int i,j,rc;
+  char *p;
+  rc = gr->boxed ? R_COLS : gr->cols;
+  p = out_room(o, gr->cols*(width+3) + 4);
+  *p++ = ' ';
+  for (i=0; i<gr->cols/rc; i++) {
+    for (j=0; j<rc*(width+1)+1; j++) *p++ = '-';
+    *p++ = ' ';
+  }
+  *p++ = '\n';
+  o->len = p - o->buf;
+}
+
+void
+print_grid(o, g)
+  struct output *o;
   struct grid *g;
 {
-  int i,j;
+  int i,j,k;
   int output_value;
-  printf("%s\n", H_LINE);
-  for (i=0; i<ROWS; i++) {
-    printf("| ");
+  int width;
+  int rr,rc;            /* rows and columns between separators */
+  char *p;
+  struct graph *gr;
+  gr = g->gr;
+  /* only the classic boxes get separators, other regions aren't rectangles */
+  rr = gr->boxed ? R_ROWS : gr->rows;
+  rc = gr->boxed ? R_COLS : gr->cols;
+  /* width of the widest value, 1 for a classic 9x9 grid */
+  for (width=1, i=MAX_VAL; i>=10; i/=10) width++;
+  print_line(o, gr, width);
+  for (i=0; i<gr->rows; i++) {
+    p = out_room(o, gr->cols*(width+3) + 4);
+    *p++ = '|';
+    *p++ = ' ';
 
-    for (j=0; j<COLS; j++) {
-      output_value = get_value(g->cells[i][j]);
-      printf(output_value == 0 ? "  " : "%d ", output_value);
+    for (j=0; j<gr->cols; j++) {
+      /* right aligned value, or blank if unsolved */
+      output_value = get_value(&g->cells[i*gr->cols + j]);
+      for (k=width-1; k>=0; k--) {
+        p[k] = output_value ? '0' + output_value%10 : ' ';
+        output_value /= 10;
+      }
+      p += width;
+      *p++ = ' ';
       /* end-of-region separator */
-      if (j%R_COLS == R_COLS-1) printf("| ");
+      if (j%rc == rc-1) {
+        *p++ = '|';
+        *p++ = ' ';
+      }
     }
-    printf("\n");
+    *p++ = '\n';
+    o->len = p - o->buf;
 
     /* extra space to separate regions */
-    if (i%R_ROWS == R_ROWS-1) printf("%s\n", H_LINE);
+    if (i%rr == rr-1) print_line(o, gr, width);
  }
 }
 
 
 /********************************************************************************
-*** Pointers to input and output grids are passed into the function.
-*** Returns boolean success or failure.
-*** Recursive process, creating local copies of the working grid
-*** until the parent call either succeeds (solves all cells) or fails.
+*** The most characters that out_result() can write for one puzzle.
 ********************************************************************************/
-int
-try(ig, og)
-  struct grid *ig;      /* the input grid to try solving */
-  struct grid *og;      /* the output grid that we copy into if we succeed */
+long
+result_size(gr)
+  struct graph *gr;
 {
-  struct grid wg;       /* a local working copy of the grid */
-  int r,reductions;
-  int tr,tc;            /* row and column for our working cell */
-  int wc;               /* working cell value, for guesses */
-  int k;                /* guess iterator */
+  int width,i;
+  for (width=1, i=MAX_VAL; i>=10; i/=10) width++;
+  /* two pretty grids and a message, or an input line and a solution line */
+  return 2L*(2*gr->rows + 2)*(gr->cols*(width+3) + 4) + 8L*gr->ncells + 64;
+}
 
-  copy_grid(ig, &wg);   /* copy the input grid into a local working grid */
 
-  /* the first thing to do is to reduce the possible cell values */
-  /* in unsolved cells of the working grid, based on the input clues */
-  reductions = 0;
-  do {
-    r = reduce_grid(&wg);
-    /* test for failure */
-    if (r == -1) {
-      return 0;
+/********************************************************************************
+*** Writes the result of solving one puzzle in the format of the output.
+*** The input grid is ig, and text is the n characters of its input line (or
+*** NULL to write it out afresh). If solved is 1 the solution is in og, if 0 the
+*** puzzle couldn't be solved, and if -1 it couldn't even be read.
+*** A failure is a message in a grid, an empty line, an empty solution in CSV
+*** or an empty record, and an empty rating.
+********************************************************************************/
+void
+out_result(o, ig, og, text, n, solved)
+  struct output *o;
+  struct grid *ig;
+  struct grid *og;
+  char *text;
+  long n;
+  int solved;
+{
+  char *p;
+  long most;
+  int rating;
+  most = 4*ig->gr->ncells;     /* longest line of a puzzle */
+  switch (o->format) {
+  case OUT_GRID:
+    if (solved == -1) {
+      out_text(o, "Failed to read: invalid input line.\n", -1L);
+      break;
+    }
+    print_grid(o, ig);
+    if (solved) print_grid(o, og);
+    else out_text(o, "Failed to solve.\n", -1L);
+    break;
+  case OUT_CSV:
+    if (n > most) n = most;
+    p = out_room(o, 2*most + 2);
+    if (text != NULL) {
+      memcpy(p, text, n);
+      p += n;
+    }
+    else {
+      p += format_line(ig, p);
     }
-    reductions = reductions + r;
+    *p++ = ',';
+    if (solved == 1) p += format_line(og, p);
+    *p++ = '\n';
+    o->len = p - o->buf;
+    break;
+  case OUT_PACK:
+    p = out_room(o, most);
+    o->len += pack_grid(ig->gr, solved == 1 ? og : NULL, (unsigned char *) p);
+    break;
+  case OUT_RATE:
+    if (solved == -1) {
+      out_text(o, "\n", 1L);
+      break;
+    }
+    if ((solved == 1) && (o->rater == NULL) && ((o->rater = new_rater(ig->gr)) == NULL)) {
+      o->failed = 1;
+    }
+    rating = (solved == 1) && (o->rater != NULL) ? rate_grid(o->rater, ig) : -1;
+    if (n > most) n = most;
+    p = out_room(o, most + 64);
+    if (text != NULL) {
+      memcpy(p, text, n);
+      p += n;
+    }
+    else {
+      p += format_line(ig, p);
+    }
+    if (rating >= 0) {
+      p += sprintf(p, ",%d.%d,%s", rating/10, rating%10, technique_name(o->rater->hardest));
+    }
+    else {
+      *p++ = ',';
+    }
+    *p++ = '\n';
+    o->len = p - o->buf;
+    break;
+  default:
+    p = out_room(o, most + 1);
+    if (solved == 1) p += format_line(og, p);
+    *p++ = '\n';
+    o->len = p - o->buf;
   }
-  while (r>0);    /* rinse and repeat until we can reduce the grid no further */
+}
 
-  /* check if the sudoku game is solved (all cells solved) */
-  /* and if we have solved it, copy the working grid into the output grid */
-  /* and return success */ 
-  if (wg.solved_counter == ROWS*COLS) {
-    copy_grid(&wg, og);   /* copy the working grid into the output grid */
-    return 1;
-  }
 
-  /* Ok, so we have a grid that is not solved, we're going to have to guess the */
-  /* next move. Find a cell with not many options (simple optimisation). */
-  choose_target_cell(&wg, &tr, &tc);
+/********************************************************************************
+*** Finds the line starting at p in a buffer that ends at end. Sets *len to its
+*** length, leaving out the new line and any carriage return before it, and
+*** returns where the line after it starts. Returns NULL if there isn't a whole
+*** line left, although the rest of the last of the input counts as a line.
+********************************************************************************/
+char *
+next_line(p, end, last, len)
+  char *p,*end;
+  int last;             /* set if the input ends with this buffer */
+  int *len;
+{
+  char *eol;
+  if (p == end) {
+    return NULL;
+  }
+  if ((eol = memchr(p, '\n', end - p)) == NULL) {
+    if (!last) return NULL;
+    eol = end;
+  }
+  *len = eol - p;
+  if ((*len > 0) && (p[*len-1] == '\r')) (*len)--;
+  return eol < end ? eol + 1 : end;
+}
 
-  /* Now loop through those possible options, updating the value of the target cell */
-  /* each time. Call try() on each potential version of the working grid. */
-  wc = wg.cells[tr][tc];
 
-  /* pretend we have solved this cell */
-  wg.solved_counter = wg.solved_counter + 1;
+/********************************************************************************
+*** Batch input is either lines of text or packed records, told apart by the
+*** header at the start of a packed file. Finds the puzzle starting at p, as
+*** next_line() does a line, and returns where the next one starts. The header
+*** counts as an empty puzzle. Sets *in to IN_BAD, and returns NULL, if the
+*** header is for puzzles of another size.
+********************************************************************************/
+#define IN_UNKNOWN 0
+#define IN_TEXT 1
+#define IN_PACK 2
+#define IN_BAD 3
 
-  /* and guess each of the possible solutions for it in turn */
-  for (k=1; k<=MAX_VAL; k++) {
-    if (wc & 1<<k) {
-      /* possible: we modify the grid */
-      wg.cells[tr][tc] = set_value(k);
-      /* now call try with the modified grid */
-      if (try(&wg, og)) {
-        /* yipee, it worked, we got there! */
-        return 1;
-      }
+char *
+next_puzzle(gr, in, p, end, last, len)
+  struct graph *gr;
+  int *in;              /* the input format, IN_UNKNOWN until we've looked */
+  char *p,*end;
+  int last;             /* set if the input ends with this buffer */
+  int *len;
+{
+  long size;
+  if (*in == IN_UNKNOWN) {
+    if ((end - p < PACK_HEADER) && !last) {
+      return NULL;
+    }
+    if ((end - p < PACK_HEADER) || (memcmp(p, PACK_MAGIC, 4) != 0)) {
+      *in = IN_TEXT;
+    }
+    else if (check_header(gr, (unsigned char *) p)) {
+      *in = IN_PACK;
+      *len = 0;
+      return p + PACK_HEADER;
+    }
+    else {
+      *in = IN_BAD;
     }
   }
-
-  /* meh, if none of the options worked, return failure */
-  return 0;
+  switch (*in) {
+  case IN_TEXT:
+    return next_line(p, end, last, len);
+  case IN_PACK:
+    if (p == end) {
+      return NULL;
+    }
+    size = end - p < MASK_SIZE(gr) ? end - p + 1 : record_size(gr, (unsigned char *) p);
+    if (size > end - p) {
+      /* a record cut short at the end fails to read, as a short line does */
+      if (!last) return NULL;
+      size = end - p;
+    }
+    *len = size;
+    return p + size;
+  }
+  return NULL;
 }
 
 
+/********************************************************************************
+*** Reads the puzzle of n characters found by next_puzzle() into the grid.
+*** Returns boolean success or failure.
+********************************************************************************/
 int
-main()
+read_puzzle(g, in, p, n)
+  struct grid *g;
+  int in;
+  char *p;
+  int n;
 {
-  struct grid ig;       /* data for the input grid (start clues) */
-  struct grid og;       /* data for the output grid (solution) */
-  grid_zero(&ig);
-  grid_zero(&og);
+  return in == IN_PACK ? unpack_grid(g, (unsigned char *) p, (long) n) : parse_line(g, p, n);
+}
 
-  if (!read_grid(&ig)) {
-    printf("Failed to read: invalid input file.\n");
-    exit(1);
+
+/********************************************************************************
+*** The index of a packed file sits beside it, in a file of the same name with
+*** .idx on the end: "SUDX", the number of puzzles between entries as 4 bytes,
+*** then the offset in the packed file of puzzle 0, INDEX_STRIDE, 2*INDEX_STRIDE
+*** and so on, as 8 bytes each. Finding puzzle n is one look up and a skip over
+*** at most INDEX_STRIDE-1 records, whose sizes come from their masks, against a
+*** scan of the whole file without it.
+********************************************************************************/
+#define INDEX_MAGIC "SUDX"
+#define INDEX_STRIDE 64
+
+FILE *
+open_index(name, mode)
+  char *name;
+  char *mode;
+{
+  char *path;
+  FILE *f;
+  if ((path = (char *) malloc(strlen(name) + 5)) == NULL) {
+    return NULL;
   }
+  strcpy(path, name);
+  strcat(path, ".idx");
+  f = fopen(path, mode);
+  free(path);
+  return f;
+}
 
-  /* print the input grid */
-  print_grid(&ig);
 
-  /* if try succeeds, we can print the output grid */
-  if (try(&ig, &og)) {
-    print_grid(&og);
-    exit(0);
+/********************************************************************************
+*** Writes the index of the named packed file. Returns boolean success or failure.
+********************************************************************************/
+int
+write_index(gr, name)
+  struct graph *gr;
+  char *name;
+{
+  struct stat st;
+  unsigned char *buf,entry[8];
+  FILE *f;
+  long at,k;
+  int fd,ok;
+
+  if (((fd = open(name, O_RDONLY)) < 0) || (fstat(fd, &st) != 0) || (st.st_size < PACK_HEADER)) {
+    return 0;
+  }
+  buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (buf == MAP_FAILED) {
+    return 0;
+  }
+  madvise(buf, st.st_size, MADV_SEQUENTIAL);
+  ok = check_header(gr, buf) && ((f = open_index(name, "wb")) != NULL);
+  if (ok) {
+    memcpy(entry, INDEX_MAGIC, 4);
+    put_number(entry + 4, (long) INDEX_STRIDE, 4);
+    fwrite(entry, 1, 8, f);
+    for (at=PACK_HEADER, k=0; at+MASK_SIZE(gr)<=st.st_size; at+=record_size(gr, buf + at), k++) {
+      if (k%INDEX_STRIDE == 0) {
+        put_number(entry, at, 8);
+        fwrite(entry, 1, 8, f);
+      }
+    }
+    ok = (fclose(f) == 0) && (at == st.st_size);
   }
- 
-  /* but if we reach here we failed to solve the sudoku */
-  printf("Failed to solve.\n");
-  exit(1);
+  munmap(buf, st.st_size);
+  return ok;
 }
 
 
+/********************************************************************************
+*** Looks up puzzle k (counting from 0) in the index of the named packed file.
+*** Returns the offset of the nearest puzzle at or before it, and sets *at to
+*** which puzzle that is, or returns -1 if there's no index.
+********************************************************************************/
+long
+find_puzzle(name, k, at)
+  char *name;
+  long k;
+  long *at;
+{
+  unsigned char entry[8];
+  FILE *f;
+  long stride,offset;
+
+  if ((f = open_index(name, "rb")) == NULL) {
+    return -1;
+  }
+  offset = -1;
+  if ((fread(entry, 1, 8, f) == 8) && (memcmp(entry, INDEX_MAGIC, 4) == 0)
+      && ((stride = get_number(entry + 4, 4)) > 0)
+      && (fseek(f, 8 + 8*(k/stride), SEEK_SET) == 0) && (fread(entry, 1, 8, f) == 8)) {
+    offset = get_number(entry, 8);
+    *at = k - k%stride;
+  }
+  fclose(f);
+  return offset;
+}
+
+
+/********************************************************************************
+*** Solution stores, as described in libsud.c. sud -s maps one read only and
+*** looks puzzles up in it; sud -a solves a batch through it and then writes it
+*** again with the puzzles of the batch added. Only puzzles that take more than
+*** a short search go in (as with the cache), so a store holds the work worth
+*** keeping and not every puzzle it has seen. The new store is written to a file
+*** beside the old one and renamed over it, so a process with the old one mapped
+*** keeps a whole store, and a store is never left half written. Appending also
+*** compacts: the new table is sized for what it holds, twice over.
+********************************************************************************/
+#define STORE_CACHE 4096       /* the cache to append with, if not given one */
+
+struct keeper {
+  unsigned char *slots;         /* a slot for each puzzle kept, as in a store */
+  long n,room;
+};
+
+
+/********************************************************************************
+*** Maps the named store, and sets *n to its length.
+*** Returns the store, or NULL if it can't be opened or isn't a store.
+********************************************************************************/
+unsigned char *
+map_store(name, n)
+  char *name;
+  long *n;
+{
+  struct stat st;
+  unsigned char *p;
+  int fd;
+  if (((fd = open(name, O_RDONLY)) < 0) || (fstat(fd, &st) != 0)) {
+    return NULL;
+  }
+  p = st.st_size > 0 ? mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+  close(fd);
+  if (p == MAP_FAILED) {
+    return NULL;
+  }
+  if (check_store(p, (long) st.st_size) == 0) {
+    munmap(p, st.st_size);
+    return NULL;
+  }
+  /* look ups land anywhere in the table */
+  madvise(p, st.st_size, MADV_RANDOM);
+  *n = st.st_size;
+  return p;
+}
+
+
+/********************************************************************************
+*** Keeps the puzzle the solver has just solved, if it's worth storing.
+*** Returns boolean success or failure.
+********************************************************************************/
+int
+keep_solution(k, s, solved)
+  struct keeper *k;
+  struct solver *s;
+  int solved;
+{
+  unsigned char *p;
+  if (!s->keyed) {
+    return 1;
+  }
+  if (k->n == k->room) {
+    k->room = k->room ? 2*k->room : 64;
+    if ((p = (unsigned char *) realloc(k->slots, k->room * STORE_SLOT)) == NULL) {
+      return 0;
+    }
+    k->slots = p;
+  }
+  p = k->slots + k->n++ * STORE_SLOT;
+  put_number(p, (long) cache_hash(s->key), 8);
+  p[8] = solved;
+  memcpy(p + 9, s->key, ROWS*COLS);
+  memcpy(p + 9 + ROWS*COLS, s->sol, ROWS*COLS);
+  return 1;
+}
+
+
+/********************************************************************************
+*** Adds the slot at p to a table with used of its slots in use, unless it
+*** holds the puzzle already. A table always keeps an empty slot, so that a
+*** look up that misses comes to an end. Returns 1 if it was added, 0 if not,
+*** and -1 if there's no room for it.
+********************************************************************************/
+int
+add_slot(table, slots, used, p)
+  unsigned char *table;
+  long slots,used;
+  unsigned char *p;
+{
+  unsigned char *q;
+  q = store_slot(table, slots, p + 9, (unsigned long) get_number(p, 8));
+  if (get_number(q, 8) != 0) {
+    return 0;
+  }
+  if (used + 1 >= slots) {
+    return -1;
+  }
+  memcpy(q, p, STORE_SLOT);
+  return 1;
+}
+
+
+/********************************************************************************
+*** Writes the named store: the puzzles of the old one, of n characters at old
+*** (or none if old is NULL), and those kept.
+*** Returns boolean success or failure.
+********************************************************************************/
+int
+write_store(name, old, n, k)
+  char *name;
+  unsigned char *old;
+  long n;
+  struct keeper *k;
+{
+  unsigned char *p,*table;
+  char *path;
+  FILE *f;
+  long slots,used,old_slots,i;
+  int ok,r;
+
+  /* the slots in use are counted rather than taken from the header, which
+  ** could be wrong */
+  old_slots = old != NULL ? check_store(old, n) : 0;
+  for (slots=0, i=0; i<old_slots; i++) {
+    if (get_number(old + STORE_HEADER + i * STORE_SLOT, 8) != 0) slots++;
+  }
+  slots = 2 * (slots + k->n);
+  if (slots < 16) slots = 16;
+  if ((p = (unsigned char *) calloc(STORE_HEADER + slots * STORE_SLOT, 1)) == NULL) {
+    return 0;
+  }
+  table = p + STORE_HEADER;
+  used = 0;
+  ok = 1;
+  for (i=0; ok && (i<old_slots); i++) {
+    if (get_number(old + STORE_HEADER + i * STORE_SLOT, 8) != 0) {
+      if ((r = add_slot(table, slots, used, old + STORE_HEADER + i * STORE_SLOT)) < 0) ok = 0;
+      else used += r;
+    }
+  }
+  for (i=0; ok && (i<k->n); i++) {
+    if ((r = add_slot(table, slots, used, k->slots + i * STORE_SLOT)) < 0) ok = 0;
+    else used += r;
+  }
+  if (!ok) {
+    free(p);
+    return 0;
+  }
+  store_header(p, slots, used);
+
+  ok = (path = (char *) malloc(strlen(name) + 5)) != NULL;
+  if (ok) {
+    strcpy(path, name);
+    strcat(path, ".tmp");
+    ok = (f = fopen(path, "wb")) != NULL;
+  }
+  if (ok) {
+    ok = fwrite(p, 1, STORE_HEADER + slots * STORE_SLOT, f) == (size_t) (STORE_HEADER + slots * STORE_SLOT);
+    ok = (fflush(f) == 0) && (fsync(fileno(f)) == 0) && ok;
+    ok = (fclose(f) == 0) && ok;
+    ok = ok && (rename(path, name) == 0);
+  }
+  free(path);
+  free(p);
+  return ok;
+}
+
+
+/********************************************************************************
+*** Compressed batch input is recognised by the magic number of gzip or zstd at
+*** its start, and is decompressed on a thread of its own into a ring of blocks
+*** that the reader takes in turn, so that decompression overlaps with parsing
+*** and solving rather than sitting in front of them.
+********************************************************************************/
+#define ZIP_BLOCK (1<<20)
+#define ZIP_BLOCKS 4
+
+int
+zip_format(p, n)
+  unsigned char *p;
+  long n;
+{
+  if ((n >= 2) && (p[0] == 0x1f) && (p[1] == 0x8b)) {
+    return ZIP_GZIP;
+  }
+  if ((n >= 4) && (p[0] == 0x28) && (p[1] == 0xb5) && (p[2] == 0x2f) && (p[3] == 0xfd)) {
+    return ZIP_ZSTD;
+  }
+  return ZIP_NONE;
+}
+
+/* whether this build can decompress a format */
+int
+zip_built(zip)
+  int zip;
+{
+#ifdef WITH_ZLIB
+  if (zip == ZIP_GZIP) return 1;
+#endif
+#ifdef WITH_ZSTD
+  if (zip == ZIP_ZSTD) return 1;
+#endif
+#if !defined(WITH_ZLIB) && !defined(WITH_ZSTD)
+  (void) zip;
+#endif
+  return 0;
+}
+
+struct inflater {
+  pthread_mutex_t lock;
+  pthread_cond_t moved;           /* signalled whenever a block is filled or used */
+  pthread_t thread;
+  int fd;                         /* the compressed input */
+  int zip;                        /* ZIP_GZIP or ZIP_ZSTD */
+  char *zs;                       /* the decompression stream */
+  int between;                    /* set between compressed streams */
+  unsigned char *in;              /* compressed input waiting */
+  long in_pos,in_len;
+  char *blocks[ZIP_BLOCKS];       /* the ring of decompressed blocks */
+  long len[ZIP_BLOCKS];
+  long filled,used;               /* number of blocks filled and used so far */
+  long pos;                       /* how far the reader is into the next block */
+  int done;                       /* set once the input has all been filled in */
+  int failed;                     /* set if the input is broken */
+  int stop;                       /* set if the reader wants no more */
+};
+
+
+/********************************************************************************
+*** Decompresses as much as fits into a block. Sets *len to how much that is,
+*** and returns 1 if there may be more to come, 0 at the end of the input and
+*** -1 if the input is broken or cut short.
+********************************************************************************/
+int
+unzip_block(u, block, len)
+  struct inflater *u;
+  char *block;
+  long *len;
+{
+  long got;
+#ifdef WITH_ZLIB
+  z_stream *z;
+  long pos;
+  int r;
+#endif
+#ifdef WITH_ZSTD
+  ZSTD_inBuffer zin;
+  ZSTD_outBuffer zout;
+  size_t zr;
+#endif
+#if !defined(WITH_ZLIB) && !defined(WITH_ZSTD)
+  (void) block;
+#endif
+
+  *len = 0;
+  while (*len < ZIP_BLOCK) {
+    if (u->in_pos == u->in_len) {
+      if ((got = read(u->fd, u->in, ZIP_BLOCK)) <= 0) {
+        return (got == 0) && u->between ? 0 : -1;
+      }
+      u->in_pos = 0;
+      u->in_len = got;
+    }
+    switch (u->zip) {
+#ifdef WITH_ZLIB
+    case ZIP_GZIP:
+      z = (z_stream *) u->zs;
+      pos = u->in_pos;
+      z->next_in = u->in + u->in_pos;
+      z->avail_in = u->in_len - u->in_pos;
+      z->next_out = (Bytef *) block + *len;
+      z->avail_out = ZIP_BLOCK - *len;
+      r = inflate(z, Z_NO_FLUSH);
+      u->in_pos = u->in_len - z->avail_in;
+      *len = ZIP_BLOCK - z->avail_out;
+      if (r == Z_STREAM_END) {
+        /* another gzip member may follow */
+        inflateReset(z);
+        u->between = 1;
+      }
+      else if ((r != Z_OK) && (r != Z_BUF_ERROR)) {
+        return -1;
+      }
+      else if (u->in_pos > pos) {
+        u->between = 0;
+      }
+      break;
+#endif
+#ifdef WITH_ZSTD
+    case ZIP_ZSTD:
+      zin.src = u->in;
+      zin.size = u->in_len;
+      zin.pos = u->in_pos;
+      zout.dst = block;
+      zout.size = ZIP_BLOCK;
+      zout.pos = *len;
+      zr = ZSTD_decompressStream((ZSTD_DStream *) u->zs, &zout, &zin);
+      if (ZSTD_isError(zr)) {
+        return -1;
+      }
+      u->in_pos = zin.pos;
+      *len = zout.pos;
+      u->between = zr == 0;
+      break;
+#endif
+    default:
+      return -1;
+    }
+  }
+  return 1;
+}
+
+
+/********************************************************************************
+*** The decompression thread: fills blocks until the input runs out or the
+*** reader stops, keeping no more than ZIP_BLOCKS ahead of it.
+********************************************************************************/
+void *
+unzip_thread(arg)
+  void *arg;
+{
+  struct inflater *u;
+  int b,r,stop;
+
+  u = (struct inflater *) arg;
+  do {
+    pthread_mutex_lock(&u->lock);
+    while ((u->filled - u->used == ZIP_BLOCKS) && !u->stop) {
+      pthread_cond_wait(&u->moved, &u->lock);
+    }
+    b = u->filled % ZIP_BLOCKS;
+    stop = u->stop;
+    pthread_mutex_unlock(&u->lock);
+    if (stop) break;
+
+    r = unzip_block(u, u->blocks[b], &u->len[b]);
+
+    pthread_mutex_lock(&u->lock);
+    if (u->len[b] > 0) u->filled++;
+    if (r == -1) u->failed = 1;
+    if (r != 1) u->done = 1;
+    pthread_cond_broadcast(&u->moved);
+    pthread_mutex_unlock(&u->lock);
+  } while (r == 1);
+  return NULL;
+}
+
+
+/********************************************************************************
+*** Frees an inflater and whatever it has got so far, once its thread is done.
+********************************************************************************/
+void
+free_inflater(u)
+  struct inflater *u;
+{
+  int k;
+  if (u->zs != NULL) {
+#ifdef WITH_ZLIB
+    if (u->zip == ZIP_GZIP) {
+      inflateEnd((z_stream *) u->zs);
+      free(u->zs);
+    }
+#endif
+#ifdef WITH_ZSTD
+    if (u->zip == ZIP_ZSTD) ZSTD_freeDStream((ZSTD_DStream *) u->zs);
+#endif
+  }
+  for (k=0; k<ZIP_BLOCKS; k++) {
+    free(u->blocks[k]);
+  }
+  free(u->in);
+  free(u);
+}
+
+
+/********************************************************************************
+*** Starts decompressing a file descriptor, whose first n characters have already
+*** been read into p. Returns NULL if there's no memory, or if the build can't.
+********************************************************************************/
+struct inflater *
+new_inflater(fd, p, n)
+  int fd;
+  char *p;
+  long n;
+{
+  struct inflater *u;
+  int k;
+
+  if ((u = (struct inflater *) calloc(1, sizeof(struct inflater))) == NULL) {
+    return NULL;
+  }
+  u->fd = fd;
+  u->zip = zip_format((unsigned char *) p, n);
+  u->in = (unsigned char *) malloc(n > ZIP_BLOCK ? n : ZIP_BLOCK);
+  if (u->in == NULL) {
+    free_inflater(u);
+    return NULL;
+  }
+  memcpy(u->in, p, n);
+  u->in_len = n;
+  for (k=0; k<ZIP_BLOCKS; k++) {
+    if ((u->blocks[k] = (char *) malloc(ZIP_BLOCK)) == NULL) {
+      free_inflater(u);
+      return NULL;
+    }
+  }
+#ifdef WITH_ZLIB
+  if (u->zip == ZIP_GZIP) {
+    if ((u->zs = (char *) calloc(1, sizeof(z_stream))) == NULL) {
+      free_inflater(u);
+      return NULL;
+    }
+    /* 16 more window bits reads a gzip header */
+    if (inflateInit2((z_stream *) u->zs, 15 + 16) != Z_OK) {
+      free(u->zs);
+      u->zs = NULL;
+      free_inflater(u);
+      return NULL;
+    }
+  }
+#endif
+#ifdef WITH_ZSTD
+  if (u->zip == ZIP_ZSTD) {
+    if ((u->zs = (char *) ZSTD_createDStream()) == NULL) {
+      free_inflater(u);
+      return NULL;
+    }
+  }
+#endif
+  if (u->zs == NULL) {
+    free_inflater(u);
+    return NULL;
+  }
+  pthread_mutex_init(&u->lock, NULL);
+  pthread_cond_init(&u->moved, NULL);
+  if (pthread_create(&u->thread, NULL, unzip_thread, (void *) u) != 0) {
+    pthread_cond_destroy(&u->moved);
+    pthread_mutex_destroy(&u->lock);
+    free_inflater(u);
+    return NULL;
+  }
+  return u;
+}
+
+
+/********************************************************************************
+*** Reads up to n decompressed characters into p, as read() does.
+*** Returns how many, 0 at the end of the input or -1 if it's broken.
+********************************************************************************/
+long
+unzip_read(u, p, n)
+  struct inflater *u;
+  char *p;
+  long n;
+{
+  int b;
+  pthread_mutex_lock(&u->lock);
+  while ((u->filled == u->used) && !u->done) {
+    pthread_cond_wait(&u->moved, &u->lock);
+  }
+  if (u->filled == u->used) {
+    pthread_mutex_unlock(&u->lock);
+    return u->failed ? -1 : 0;
+  }
+  pthread_mutex_unlock(&u->lock);
+
+  b = u->used % ZIP_BLOCKS;
+  if (n > u->len[b] - u->pos) n = u->len[b] - u->pos;
+  memcpy(p, u->blocks[b] + u->pos, n);
+  if ((u->pos += n) == u->len[b]) {
+    /* hand the block back to be filled again */
+    u->pos = 0;
+    pthread_mutex_lock(&u->lock);
+    u->used++;
+    pthread_cond_broadcast(&u->moved);
+    pthread_mutex_unlock(&u->lock);
+  }
+  return n;
+}
+
+
+/********************************************************************************
+*** Stops decompressing and frees everything.
+*** Returns boolean success or failure (if the input was broken).
+********************************************************************************/
+int
+end_inflater(u)
+  struct inflater *u;
+{
+  int ok;
+  pthread_mutex_lock(&u->lock);
+  u->stop = 1;
+  pthread_cond_broadcast(&u->moved);
+  pthread_mutex_unlock(&u->lock);
+  pthread_join(u->thread, NULL);
+  ok = !u->failed;
+  pthread_cond_destroy(&u->moved);
+  pthread_mutex_destroy(&u->lock);
+  free_inflater(u);
+  return ok;
+}
+
+
+/********************************************************************************
+*** Reads a whole input file and hands it to handler(arg, p, n, last) a buffer at
+*** a time. A regular file is mapped into memory and handed over where it lies.
+*** Anything else (a pipe, say) is read a block at a time, as is anything
+*** compressed, through an inflater. The handler returns
+*** how many characters it has used up, which is whole lines unless last is set,
+*** or -1 to stop. A line too long for a block is handed over on its own as the
+*** last of a buffer, cut short, and the rest of it thrown away.
+*** Returns boolean success or failure.
+********************************************************************************/
+#define READ_BLOCK (1<<20)
+
+int
+read_lines(fd, handler, arg)
+  int fd;
+  long (*handler)();
+  char *arg;
+{
+  struct stat st;
+  struct inflater *u;
+  char *buf,*eol;
+  long have,used;
+  int got,skip,ok;
+
+  used = 0;
+  if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) && (st.st_size > 0)) {
+    buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if ((buf != MAP_FAILED) && (zip_format((unsigned char *) buf, (long) st.st_size) == ZIP_NONE)) {
+      madvise(buf, st.st_size, MADV_SEQUENTIAL);
+      used = (*handler)(arg, buf, (long) st.st_size, 1);
+      munmap(buf, st.st_size);
+      return used >= 0;
+    }
+    if (buf != MAP_FAILED) munmap(buf, st.st_size);
+  }
+
+  if ((buf = (char *) malloc(READ_BLOCK)) == NULL) {
+    return 0;
+  }
+  /* the first few characters tell us if the input is compressed */
+  for (have=0; (have < 4) && ((got = read(fd, buf + have, READ_BLOCK - have)) > 0); have+=got);
+  u = NULL;
+  if (zip_format((unsigned char *) buf, have) != ZIP_NONE) {
+    if (!zip_built(zip_format((unsigned char *) buf, have))) {
+      printf("Failed to read: compressed input not supported by this build.\n");
+      fflush(stdout);
+      free(buf);
+      return 0;
+    }
+    if ((u = new_inflater(fd, buf, have)) == NULL) {
+      free(buf);
+      return 0;
+    }
+    have = 0;
+  }
+  skip = 0;
+  while ((got = u ? unzip_read(u, buf + have, READ_BLOCK - have) : read(fd, buf + have, READ_BLOCK - have)) > 0) {
+    have += got;
+    if (skip) {
+      /* throw away the rest of a line that was too long */
+      if ((eol = (char *) memchr(buf, '\n', have)) == NULL) {
+        have = 0;
+        continue;
+      }
+      used = eol + 1 - buf;
+      have -= used;
+      memmove(buf, buf + used, have);
+      skip = 0;
+    }
+    if ((used = (*handler)(arg, buf, have, 0)) < 0) {
+      break;
+    }
+    have -= used;
+    memmove(buf, buf + used, have);
+    if (have == READ_BLOCK) {
+      /* no puzzle is this long, so it can only fail */
+      if ((used = (*handler)(arg, buf, have, 1)) < 0) {
+        break;
+      }
+      have = 0;
+      skip = 1;
+    }
+  }
+  if ((have > 0) && (used >= 0)) {
+    used = (*handler)(arg, buf, have, 1);
+  }
+  free(buf);
+  ok = (u == NULL) || end_inflater(u);
+  return ok && (got == 0) && (used >= 0);
+}
+
+
+/********************************************************************************
+*** Batch mode: solves every puzzle in a buffer of puzzles, one puzzle to a line
+*** as read by parse_line() or packed, and writes the result of each with
+*** out_result(), so the output always lines up with the input. Empty lines are
+*** skipped. The batch can skip some puzzles first and stop after some more, and
+*** can just copy the puzzles to the output as if they were solved, to convert
+*** them from one format to another, or write their canonical forms instead.
+*** It can also keep the puzzles it solves for a solution store.
+*** This is the handler for read_lines() when solving on one thread.
+*** Returns the number of characters used up.
+********************************************************************************/
+struct batch {
+  struct solver *s;
+  struct grid *ig;      /* grids to work with, for the graph of the puzzles */
+  struct grid *og;
+  struct output *o;
+  int in;               /* the input format, as for next_puzzle() */
+  long skip;            /* number of puzzles to skip, */
+  long left;            /* and to solve after that, or -1 for all of them */
+  int convert;          /* CONVERT_COPY or CONVERT_CANON rather than solve them */
+  struct keeper *keep;  /* where to keep solutions for a store, if anywhere */
+  long failed;          /* number of puzzles not solved */
+};
+
+#define CONVERT_COPY 1
+#define CONVERT_CANON 2
+
+long
+solve_buffer(b, p, n, last)
+  struct batch *b;
+  char *p;
+  long n;
+  int last;             /* set if the input ends with this buffer */
+{
+  struct transform t;
+  char *start,*end,*next;
+  int len,solved;
+
+  start = p;
+  end = p + n;
+  while ((b->left != 0) && ((next = next_puzzle(b->ig->gr, &b->in, p, end, last, &len)) != NULL)) {
+    if ((len > 0) && (b->skip > 0)) {
+      b->skip--;
+    }
+    else if (len > 0) {
+      /* the clues go straight from the buffer into the grid */
+      grid_zero(b->ig, b->ig->gr);
+      if (!read_puzzle(b->ig, b->in, p, len)) {
+        solved = -1;
+      }
+      else if (b->convert == CONVERT_COPY) {
+        copy_grid(b->ig, b->og);
+        solved = 1;
+      }
+      else if (b->convert == CONVERT_CANON) {
+        canonical_form(b->s->canon, b->ig, &t);
+        transform_grid(&t, b->ig, b->og, 0);
+        solved = 1;
+      }
+      else {
+        solved = solve_grid(b->s, b->ig, b->og);
+        if ((b->keep != NULL) && !keep_solution(b->keep, b->s, solved)) {
+          return -1;
+        }
+      }
+      out_result(b->o, b->ig, b->og, b->in == IN_TEXT ? p : NULL, (long) len, solved);
+      if (solved != 1) b->failed++;
+      if (b->left > 0) b->left--;
+    }
+    p = next;
+  }
+  if (b->in == IN_BAD) {
+    return -1;
+  }
+  /* once we have all we want, the rest of the input goes unread */
+  return b->left == 0 ? n : p - start;
+}
+
+
+/********************************************************************************
+*** Batch mode for a whole input file, on one thread.
+*** Returns boolean success or failure (of any of the puzzles).
+********************************************************************************/
+int
+solve_lines(s, ig, og, fd, o, convert, keep)
+  struct solver *s;
+  struct grid *ig;
+  struct grid *og;
+  int fd;
+  struct output *o;
+  int convert;          /* CONVERT_COPY or CONVERT_CANON rather than solve them */
+  struct keeper *keep;  /* where to keep solutions for a store, if anywhere */
+{
+  struct batch b;
+  int ok;
+  b.s = s;
+  b.ig = ig;
+  b.og = og;
+  b.o = o;
+  b.in = IN_UNKNOWN;
+  b.skip = 0;
+  b.left = -1;
+  b.convert = convert;
+  b.keep = keep;
+  b.failed = 0;
+  ok = read_lines(fd, solve_buffer, (char *) &b);
+  return out_flush(o) && ok && (b.failed == 0);
+}
+
+
+/********************************************************************************
+*** Solves just puzzle number k of a batch, counting from 1. A packed file with
+*** an index goes straight to it, anything else is read up to it.
+*** Returns boolean success or failure.
+********************************************************************************/
+int
+solve_number(s, ig, og, fd, name, o, k)
+  struct solver *s;
+  struct grid *ig;
+  struct grid *og;
+  int fd;
+  char *name;           /* the name of the input file, or NULL */
+  struct output *o;
+  long k;
+{
+  struct batch b;
+  struct stat st;
+  char *buf;
+  long offset,at;
+  int ok;
+
+  b.s = s;
+  b.ig = ig;
+  b.og = og;
+  b.o = o;
+  b.in = IN_UNKNOWN;
+  b.skip = k - 1;
+  b.left = 1;
+  b.convert = 0;
+  b.failed = 0;
+  ok = -1;
+  if ((name != NULL) && (fstat(fd, &st) == 0) && S_ISREG(st.st_mode) && (st.st_size >= PACK_HEADER)
+      && ((offset = find_puzzle(name, k - 1, &at)) >= PACK_HEADER) && (offset <= st.st_size)) {
+    buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (buf != MAP_FAILED) {
+      if (check_header(ig->gr, (unsigned char *) buf)) {
+        b.in = IN_PACK;
+        b.skip = k - 1 - at;
+        ok = solve_buffer(&b, buf + offset, st.st_size - offset, 1) >= 0;
+      }
+      munmap(buf, st.st_size);
+    }
+  }
+  if (ok == -1) {
+    ok = read_lines(fd, solve_buffer, (char *) &b);
+  }
+  return out_flush(o) && ok && (b.left == 0) && (b.failed == 0);
+}
+
+
+/********************************************************************************
+*** Batch mode on many threads. The puzzles go through a pipeline in chunks of
+*** lines: this thread reads them and parses each chunk into its grids, a pool of
+*** solver threads each take the next chunk waiting, solve it and write the
+*** results into the chunk's own output, and a writer thread hands the outputs
+*** over in the order the chunks were read, so the output is the same as on one
+*** thread. Used chunks go back to be filled again, so the reader can only get
+*** so far ahead of the writer. A single lock guards the lists of chunks and
+*** everyone waits on the same condition, which is signalled whenever a chunk
+*** moves on: chunks are big enough that this is rare.
+********************************************************************************/
+#define CHUNK_LINES 256
+#define CHUNKS_PER_THREAD 4
+
+struct chunk {
+  struct chunk *next;
+  long seq;             /* place of the chunk in the input */
+  int n;                /* number of puzzles in it */
+  char *grids;          /* the input grids, GRID_SIZE() apart */
+  int *solved;          /* as for out_result(), -1 if the line couldn't be read */
+  char *text;           /* the input lines, kept for CSV and ratings, most apart */
+  int *len;             /* their lengths */
+  struct output *out;   /* the results */
+  long failed;          /* number of puzzles not solved */
+};
+
+struct pipeline {
+  pthread_mutex_t lock;
+  pthread_cond_t moved;           /* signalled whenever a chunk moves on */
+  struct graph *gr;
+  int lines;                      /* most lines in a chunk */
+  long most;                      /* longest line kept for a puzzle */
+  struct chunk *spare;            /* chunks waiting to be filled */
+  struct chunk *todo,*todo_last;  /* chunks waiting to be solved, in order */
+  struct chunk *done;             /* chunks waiting to be written */
+  struct chunk *filling;          /* the chunk the reader is filling */
+  int in;                         /* the input format, as for next_puzzle() */
+  long nread;                     /* number of chunks read so far */
+  int finished;                   /* set once everything has been read */
+  int failed;                     /* set if a thread ran out of memory */
+  struct output *o;               /* the real output, for the writer */
+  long unsolved;                  /* number of puzzles not solved */
+  struct solver *model;           /* whose budget and cache every solver takes */
+};
+
+
+/********************************************************************************
+*** Frees a list of chunks.
+********************************************************************************/
+void
+free_chunks(c)
+  struct chunk *c;
+{
+  struct chunk *next;
+  for (; c != NULL; c=next) {
+    next = c->next;
+    free(c->grids);
+    free(c->solved);
+    free(c->len);
+    free(c->text);
+    free_output(c->out);
+    free(c);
+  }
+}
+
+
+/********************************************************************************
+*** Makes a chunk for the pipeline. Returns NULL if there's no memory.
+********************************************************************************/
+struct chunk *
+new_chunk(pl, format)
+  struct pipeline *pl;
+  int format;
+{
+  struct chunk *c;
+  c = (struct chunk *) calloc(1, sizeof(struct chunk));
+  if (c == NULL) {
+    return NULL;
+  }
+  c->grids = (char *) malloc(pl->lines * GRID_SIZE(pl->gr));
+  c->solved = (int *) malloc(pl->lines * sizeof(int));
+  c->len = (int *) malloc(pl->lines * sizeof(int));
+  c->text = (char *) malloc((format == OUT_CSV) || (format == OUT_RATE) ? pl->lines * pl->most : 1);
+  c->out = new_output(-1, format, pl->lines * result_size(pl->gr));
+  if ((c->grids == NULL) || (c->solved == NULL) || (c->len == NULL)
+      || (c->text == NULL) || (c->out == NULL)) {
+    free_chunks(c);
+    return NULL;
+  }
+  return c;
+}
+
+
+/********************************************************************************
+*** Passes the chunk being filled on to the solvers. Called with the lock held.
+********************************************************************************/
+void
+queue_chunk(pl)
+  struct pipeline *pl;
+{
+  struct chunk *c;
+  c = pl->filling;
+  pl->filling = NULL;
+  c->seq = pl->nread++;
+  c->next = NULL;
+  if (pl->todo == NULL) pl->todo = c;
+  else pl->todo_last->next = c;
+  pl->todo_last = c;
+  pthread_cond_broadcast(&pl->moved);
+}
+
+
+/********************************************************************************
+*** The reader: the handler for read_lines() that parses a buffer of puzzles
+*** into chunks, as solve_buffer() does. Returns the number of characters used
+*** up, or -1 if the pipeline has failed.
+********************************************************************************/
+long
+queue_buffer(pl, p, n, last)
+  struct pipeline *pl;
+  char *p;
+  long n;
+  int last;             /* set if the input ends with this buffer */
+{
+  struct chunk *c;
+  struct grid *ig;
+  char *start,*end,*next;
+  int len;
+
+  start = p;
+  end = p + n;
+  while ((next = next_puzzle(pl->gr, &pl->in, p, end, last, &len)) != NULL) {
+    if (len > 0) {
+      if ((c = pl->filling) == NULL) {
+        pthread_mutex_lock(&pl->lock);
+        while ((pl->spare == NULL) && !pl->failed) {
+          pthread_cond_wait(&pl->moved, &pl->lock);
+        }
+        if (pl->failed) {
+          pthread_mutex_unlock(&pl->lock);
+          return -1;
+        }
+        c = pl->filling = pl->spare;
+        pl->spare = c->next;
+        c->next = NULL;
+        pthread_mutex_unlock(&pl->lock);
+        c->n = 0;
+      }
+      ig = (struct grid *) (c->grids + c->n * GRID_SIZE(pl->gr));
+      grid_zero(ig, pl->gr);
+      c->solved[c->n] = read_puzzle(ig, pl->in, p, len) ? 0 : -1;
+      if (((c->out->format == OUT_CSV) || (c->out->format == OUT_RATE)) && (pl->in == IN_TEXT)) {
+        c->len[c->n] = len < pl->most ? len : pl->most;
+        memcpy(c->text + c->n * pl->most, p, c->len[c->n]);
+      }
+      if (++c->n == pl->lines) {
+        pthread_mutex_lock(&pl->lock);
+        queue_chunk(pl);
+        pthread_mutex_unlock(&pl->lock);
+      }
+    }
+    p = next;
+  }
+  if (pl->in == IN_BAD) {
+    return -1;
+  }
+  return p - start;
+}
+
+
+/********************************************************************************
+*** A solver thread: solves chunks until there are none left to read.
+********************************************************************************/
+void *
+solver_thread(arg)
+  void *arg;
+{
+  struct pipeline *pl;
+  struct solver *s;
+  struct grid *ig,*og;
+  struct chunk *c;
+  int i;
+
+  pl = (struct pipeline *) arg;
+  s = new_solver(pl->gr);
+  og = new_grid(pl->gr);
+  pthread_mutex_lock(&pl->lock);
+  if ((s == NULL) || (og == NULL)) {
+    pl->failed = 1;
+    pthread_cond_broadcast(&pl->moved);
+  }
+  else {
+    s->budget = pl->model->budget;
+    s->cache = pl->model->cache;
+    s->store = pl->model->store;
+    s->store_slots = pl->model->store_slots;
+  }
+  while (!pl->failed) {
+    if ((c = pl->todo) == NULL) {
+      if (pl->finished) break;
+      pthread_cond_wait(&pl->moved, &pl->lock);
+      continue;
+    }
+    pl->todo = c->next;
+    pthread_mutex_unlock(&pl->lock);
+
+    c->out->len = 0;
+    c->failed = 0;
+    for (i=0; i<c->n; i++) {
+      ig = (struct grid *) (c->grids + i * GRID_SIZE(pl->gr));
+      if (c->solved[i] == 0) c->solved[i] = solve_grid(s, ig, og);
+      if (((c->out->format == OUT_CSV) || (c->out->format == OUT_RATE)) && (pl->in == IN_TEXT)) {
+        out_result(c->out, ig, og, c->text + i * pl->most, (long) c->len[i], c->solved[i]);
+      }
+      else {
+        out_result(c->out, ig, og, NULL, 0L, c->solved[i]);
+      }
+      if (c->solved[i] != 1) c->failed++;
+    }
+
+    pthread_mutex_lock(&pl->lock);
+    c->next = pl->done;
+    pl->done = c;
+    pthread_cond_broadcast(&pl->moved);
+  }
+  pthread_mutex_unlock(&pl->lock);
+  free_solver(s);
+  free(og);
+  return NULL;
+}
+
+
+/********************************************************************************
+*** The writer thread: writes out the chunks in order until they've all been
+*** written, and hands each one back to the reader.
+********************************************************************************/
+void *
+writer_thread(arg)
+  void *arg;
+{
+  struct pipeline *pl;
+  struct chunk *c,**cp;
+  long seq;
+
+  pl = (struct pipeline *) arg;
+  seq = 0;
+  pthread_mutex_lock(&pl->lock);
+  while (!pl->failed && !(pl->finished && (seq == pl->nread))) {
+    /* look for the next chunk among those done */
+    for (cp=&pl->done; (*cp != NULL) && ((*cp)->seq != seq); cp=&(*cp)->next);
+    if ((c = *cp) == NULL) {
+      pthread_cond_wait(&pl->moved, &pl->lock);
+      continue;
+    }
+    *cp = c->next;
+    pthread_mutex_unlock(&pl->lock);
+
+    out_text(pl->o, c->out->buf, c->out->len);
+    pl->unsolved += c->failed;
+    seq++;
+
+    pthread_mutex_lock(&pl->lock);
+    c->next = pl->spare;
+    pl->spare = c;
+    pthread_cond_broadcast(&pl->moved);
+  }
+  pthread_mutex_unlock(&pl->lock);
+  return NULL;
+}
+
+
+/********************************************************************************
+*** Batch mode for a whole input file, on the given number of solver threads.
+*** Returns boolean success or failure (of any of the puzzles).
+********************************************************************************/
+int
+solve_pipeline(gr, fd, o, threads, model)
+  struct graph *gr;
+  int fd;
+  struct output *o;
+  int threads;
+  struct solver *model;
+{
+  struct pipeline pl;
+  struct chunk *c;
+  pthread_t *solvers,writer;
+  int i,ok,started,writing;
+
+  pthread_mutex_init(&pl.lock, NULL);
+  pthread_cond_init(&pl.moved, NULL);
+  pl.gr = gr;
+  pl.most = 4*gr->ncells;
+  /* keep a chunk's output no bigger than the real one, if we can */
+  pl.lines = OUT_BUFFER / result_size(gr);
+  if (pl.lines > CHUNK_LINES) pl.lines = CHUNK_LINES;
+  if (pl.lines < 1) pl.lines = 1;
+  pl.spare = pl.todo = pl.todo_last = pl.done = pl.filling = NULL;
+  pl.in = IN_UNKNOWN;
+  pl.nread = 0;
+  pl.finished = 0;
+  pl.failed = 0;
+  pl.o = o;
+  pl.unsolved = 0;
+  pl.model = model;
+  ok = 1;
+  for (i=0; ok && (i<CHUNKS_PER_THREAD*threads); i++) {
+    if ((c = new_chunk(&pl, o->format)) == NULL) {
+      ok = 0;
+      break;
+    }
+    c->next = pl.spare;
+    pl.spare = c;
+  }
+
+  solvers = ok ? (pthread_t *) malloc(threads * sizeof(pthread_t)) : NULL;
+  if (solvers == NULL) ok = 0;
+  for (started=0; ok && (started<threads); started++) {
+    if (pthread_create(&solvers[started], NULL, solver_thread, (void *) &pl) != 0) {
+      ok = 0;
+      break;
+    }
+  }
+  writing = ok && (pthread_create(&writer, NULL, writer_thread, (void *) &pl) == 0);
+  if (!writing) ok = 0;
+
+  if (ok) {
+    ok = read_lines(fd, queue_buffer, (char *) &pl);
+  }
+
+  /* send off the last chunk, however full, and tell everyone we're done; or
+  ** if we couldn't get going, stop the threads that did */
+  pthread_mutex_lock(&pl.lock);
+  if (!writing) pl.failed = 1;
+  else if (pl.filling != NULL) queue_chunk(&pl);
+  pl.finished = 1;
+  pthread_cond_broadcast(&pl.moved);
+  pthread_mutex_unlock(&pl.lock);
+
+  for (i=0; i<started; i++) {
+    pthread_join(solvers[i], NULL);
+  }
+  if (writing) pthread_join(writer, NULL);
+
+  free_chunks(pl.spare);
+  free_chunks(pl.todo);
+  free_chunks(pl.done);
+  free_chunks(pl.filling);
+  free(solvers);
+  pthread_mutex_destroy(&pl.lock);
+  pthread_cond_destroy(&pl.moved);
+  return out_flush(o) && ok && !pl.failed && (pl.unsolved == 0);
+}
+
+
+/********************************************************************************
+*** Generating puzzles on many threads. Each thread makes puzzles with a solver
+*** and a seed of its own, a batch at a time, into an output buffer of its own,
+*** and writes the batch out whole, so the threads only meet to take on a batch
+*** and to write one. The order of the puzzles depends on which thread gets to
+*** the output first, so only a single thread gives the same puzzles every time
+*** for a seed. Each grid comes from a random walk of steps steps of its own,
+*** or from just a search if steps is 0. A puzzle with more
+*** clues than the target is thrown away and another made, so a target far
+*** below what taking clues away can reach (20 for the classic game, say) may
+*** take a very long time.
+********************************************************************************/
+#define GEN_BATCH 64
+
+struct generator {
+  pthread_mutex_t lock;
+  struct graph *gr;
+  struct output *o;     /* where the puzzles go */
+  long left;            /* puzzles still to be taken on */
+  int sym;              /* SYM_NONE or the symmetry of the clues */
+  int target;           /* most clues, or 0 for as few as there can be */
+  long steps;           /* steps of the walk to each grid, or 0 to search */
+  unsigned long long seed;
+  int threads;          /* threads started so far, to seed each differently */
+  int failed;           /* set if a thread ran out of memory */
+};
+
+
+void *
+generator_thread(arg)
+  void *arg;
+{
+  struct generator *ge;
+  struct solver *s;
+  struct grid *ig,*sg,*pg,*tg;
+  struct output *out;
+  long n,made;
+  int clues;
+
+  ge = (struct generator *) arg;
+  s = new_solver(ge->gr);
+  ig = new_grid(ge->gr);
+  sg = new_grid(ge->gr);
+  pg = new_grid(ge->gr);
+  tg = new_grid(ge->gr);
+  out = new_output(-1, ge->o->format, GEN_BATCH * result_size(ge->gr));
+  pthread_mutex_lock(&ge->lock);
+  if ((s == NULL) || (ig == NULL) || (sg == NULL) || (pg == NULL) || (tg == NULL) || (out == NULL)) {
+    ge->failed = 1;
+  }
+  else {
+    s->seed = ge->seed + 0x9e3779b97f4a7c15ULL * ++ge->threads;
+  }
+  while (!ge->failed && (ge->left > 0)) {
+    n = ge->left < GEN_BATCH ? ge->left : GEN_BATCH;
+    ge->left -= n;
+    pthread_mutex_unlock(&ge->lock);
+
+    out->len = 0;
+    for (made=0; made<n; ) {
+      reset_solver(s);
+      if (!sample_grid(s, ig, sg, ge->steps) || ((clues = make_puzzle(s, sg, pg, tg, ge->sym, ge->target)) < 0)) {
+        break;
+      }
+      if ((ge->target > 0) && (clues > ge->target)) continue;
+      /* the puzzle as a line or record, with its solution in a grid or CSV */
+      out_result(out, pg, (out->format == OUT_LINE) || (out->format == OUT_PACK) ? pg : sg,
+                 NULL, 0L, 1);
+      made++;
+    }
+
+    pthread_mutex_lock(&ge->lock);
+    if (made < n) ge->failed = 1;
+    out_text(ge->o, out->buf, out->len);
+  }
+  pthread_mutex_unlock(&ge->lock);
+  free_solver(s);
+  free(ig); free(sg); free(pg); free(tg);
+  free_output(out);
+  return NULL;
+}
+
+
+/********************************************************************************
+*** Generates number puzzles on the given number of threads.
+*** Returns boolean success or failure.
+********************************************************************************/
+int
+generate_puzzles(gr, o, number, threads, sym, target, steps, seed)
+  struct graph *gr;
+  struct output *o;
+  long number;
+  int threads;
+  int sym;
+  int target;
+  long steps;
+  unsigned long long seed;
+{
+  struct generator ge;
+  pthread_t *generators;
+  int i,started;
+
+  pthread_mutex_init(&ge.lock, NULL);
+  ge.gr = gr;
+  ge.o = o;
+  ge.left = number;
+  ge.sym = sym;
+  ge.target = target;
+  ge.steps = steps;
+  ge.seed = seed;
+  ge.threads = 0;
+  ge.failed = 0;
+  generators = (pthread_t *) malloc(threads * sizeof(pthread_t));
+  if (generators == NULL) {
+    pthread_mutex_destroy(&ge.lock);
+    return 0;
+  }
+  for (started=0; started<threads; started++) {
+    if (pthread_create(&generators[started], NULL, generator_thread, (void *) &ge) != 0) {
+      /* the threads already going stop after the batch they are on */
+      pthread_mutex_lock(&ge.lock);
+      ge.failed = 1;
+      pthread_mutex_unlock(&ge.lock);
+      break;
+    }
+  }
+  for (i=0; i<started; i++) {
+    pthread_join(generators[i], NULL);
+  }
+  free(generators);
+  pthread_mutex_destroy(&ge.lock);
+  return out_flush(o) && !ge.failed;
+}
+
+
+/********************************************************************************
+*** Hunting the minimal puzzles of each grid of a batch, with targets from the
+*** fewest clues asked for and up. A hunt of more than HUNT_SPLIT clues stops at
+*** that depth and leaves the branches it comes to as tasks, which the threads
+*** share out one at a time, each with a hunt of its own that starts from the
+*** unavoidable sets the first hunt found; the sets they find are brought back
+*** to it before the next target. The puzzles come out as each thread finds them, the lowest clue
+*** counts first. A target needs none below it to have been hunted first, they
+*** only bring more unavoidable sets, so a hunt can start where the puzzles are:
+*** no classic grid has a puzzle of fewer than 17 clues, and proving that target
+*** by target costs around ten times as much for each clue more, so even a hunt
+*** of just the 17 clue puzzles of a grid takes a long while.
+********************************************************************************/
+#define HUNT_SPLIT 3
+
+struct hunter {
+  pthread_mutex_t lock;
+  struct hunt *h;       /* the first hunt, with the tasks */
+  struct grid *sg;      /* the grid being hunted */
+  struct output *o;     /* where the puzzles go */
+  long next;            /* the next task to take on */
+  int failed;           /* set if a hunt gave up */
+};
+
+struct hunt_thread {
+  struct hunter *hu;
+  struct hunt *h;
+  pthread_t thread;
+};
+
+
+void
+found_puzzle(hu, pg)
+  struct hunter *hu;
+  struct grid *pg;
+{
+  pthread_mutex_lock(&hu->lock);
+  out_result(hu->o, pg, (hu->o->format == OUT_LINE) || (hu->o->format == OUT_PACK) ? pg : hu->sg,
+             NULL, 0L, 1);
+  pthread_mutex_unlock(&hu->lock);
+}
+
+
+void *
+hunt_thread(arg)
+  void *arg;
+{
+  struct hunt_thread *ht;
+  struct hunter *hu;
+  long k;
+
+  ht = (struct hunt_thread *) arg;
+  hu = ht->hu;
+  if (!join_hunt(ht->h, hu->h)) {
+    pthread_mutex_lock(&hu->lock);
+    hu->failed = 1;
+    pthread_mutex_unlock(&hu->lock);
+    return NULL;
+  }
+  for (;;) {
+    pthread_mutex_lock(&hu->lock);
+    k = hu->failed ? hu->h->ntasks : hu->next++;
+    pthread_mutex_unlock(&hu->lock);
+    if (k >= hu->h->ntasks) break;
+    if (!hunt_task(ht->h, hu->h, k)) {
+      pthread_mutex_lock(&hu->lock);
+      hu->failed = 1;
+      pthread_mutex_unlock(&hu->lock);
+    }
+  }
+  return NULL;
+}
+
+
+/********************************************************************************
+*** Hunts the minimal puzzles of least up to clues clues of the solution grid sg,
+*** on the threads. Returns boolean success or failure.
+********************************************************************************/
+int
+hunt_grid(hu, threads, ht, sg, least, clues)
+  struct hunter *hu;
+  int threads;
+  struct hunt_thread *ht;
+  struct grid *sg;
+  int least;
+  int clues;
+{
+  struct hunt *h;
+  int i,t,started;
+
+  h = hu->h;
+  hu->sg = sg;
+  hu->failed = 0;
+  if (!start_hunt(h, sg)) {
+    return 0;
+  }
+  for (t=least; (t<=clues) && !hu->failed; t++) {
+    h->target = t;
+    h->split = (threads > 1) && (t > HUNT_SPLIT) ? HUNT_SPLIT : -1;
+    h->ntasks = 0;
+    memset(h->clues, 0, 2 * h->words * sizeof(unsigned long long));
+    if (!hunt_search(h, 0)) {
+      return 0;
+    }
+    if (h->ntasks == 0) continue;
+
+    hu->next = 0;
+    for (started=0; started<threads; started++) {
+      ht[started].hu = hu;
+      if (pthread_create(&ht[started].thread, NULL, hunt_thread, (void *) &ht[started]) != 0) {
+        /* the threads already going stop after the task they are on */
+        pthread_mutex_lock(&hu->lock);
+        hu->failed = 1;
+        pthread_mutex_unlock(&hu->lock);
+        break;
+      }
+    }
+    for (i=0; i<started; i++) {
+      pthread_join(ht[i].thread, NULL);
+    }
+    for (i=0; (i<threads) && !hu->failed; i++) {
+      if (!share_sets(h, ht[i].h)) return 0;
+    }
+  }
+  return !hu->failed;
+}
+
+
+/********************************************************************************
+*** Solves each puzzle of a batch to a grid, and hunts the grid's minimal
+*** puzzles. This is the handler for read_lines().
+*** Returns the number of characters used up.
+********************************************************************************/
+struct hunt_batch {
+  struct hunter hu;
+  struct hunt_thread *ht;
+  int threads;
+  struct solver *s;
+  struct grid *ig;
+  struct grid *sg;
+  int in;               /* the input format, as for next_puzzle() */
+  int least;            /* the fewest clues to hunt for, */
+  int clues;            /* and the most */
+  long failed;          /* number of puzzles not solved */
+};
+
+long
+hunt_buffer(b, p, n, last)
+  struct hunt_batch *b;
+  char *p;
+  long n;
+  int last;
+{
+  char *start,*end,*next;
+  int len,solved;
+
+  start = p;
+  end = p + n;
+  while ((next = next_puzzle(b->ig->gr, &b->in, p, end, last, &len)) != NULL) {
+    if (len > 0) {
+      grid_zero(b->ig, b->ig->gr);
+      solved = read_puzzle(b->ig, b->in, p, len) ? solve_grid(b->s, b->ig, b->sg) : -1;
+      if (solved != 1) {
+        out_result(b->hu.o, b->ig, b->sg, NULL, 0L, solved);
+        b->failed++;
+      }
+      else if (!hunt_grid(&b->hu, b->threads, b->ht, b->sg, b->least, b->clues)) {
+        return -1;
+      }
+    }
+    p = next;
+  }
+  if (b->in == IN_BAD) {
+    return -1;
+  }
+  return p - start;
+}
+
+
+/********************************************************************************
+*** Hunts the minimal puzzles of every grid of a batch, of least up to clues
+*** clues, on the given number of threads. Returns boolean success or failure.
+********************************************************************************/
+int
+hunt_lines(s, ig, og, fd, o, threads, least, clues)
+  struct solver *s;
+  struct grid *ig;
+  struct grid *og;
+  int fd;
+  struct output *o;
+  int threads;
+  int least;
+  int clues;
+{
+  struct hunt_batch b;
+  int i,ok;
+
+  pthread_mutex_init(&b.hu.lock, NULL);
+  b.hu.o = o;
+  b.s = s;
+  b.ig = ig;
+  b.sg = og;
+  b.in = IN_UNKNOWN;
+  b.least = least;
+  b.clues = clues;
+  b.failed = 0;
+  b.threads = threads;
+  b.ht = (struct hunt_thread *) calloc(threads, sizeof(struct hunt_thread));
+  b.hu.h = new_hunt(ig->gr, found_puzzle, (char *) &b.hu);
+  ok = (b.ht != NULL) && (b.hu.h != NULL);
+  for (i=0; ok && (i<threads); i++) {
+    ok = (b.ht[i].h = new_hunt(ig->gr, found_puzzle, (char *) &b.hu)) != NULL;
+  }
+  if (ok) {
+    ok = read_lines(fd, hunt_buffer, (char *) &b);
+  }
+  for (i=0; (b.ht != NULL) && (i<threads); i++) {
+    free_hunt(b.ht[i].h);
+  }
+  free_hunt(b.hu.h);
+  free(b.ht);
+  pthread_mutex_destroy(&b.hu.lock);
+  return out_flush(o) && ok && (b.failed == 0);
+}
+
+
+int
+main(argc, argv)
+  int argc;
+  char *argv[];
+{
+  struct grid *ig;             /* data for the input grid (start clues) */
+  struct grid *og;             /* data for the output grid (solution) */
+  struct graph *gr;            /* the rules of the puzzle */
+  char *description;           /* file describing a variant puzzle */
+  int lines;                   /* batch mode, one puzzle per line */
+  int format;                  /* how to write the solutions */
+  int threads;                 /* number of threads solving a batch */
+  long number;                 /* the one puzzle of a batch to solve, if not 0 */
+  int indexing;                /* just index a packed file */
+  int convert;                 /* copy a batch to the output without solving it, or canonise it */
+  int zip;                     /* how to compress the output */
+  struct sud_budget budget;    /* limits on the search for each puzzle */
+  long cached;                 /* number of solutions to cache, if any */
+  char *store;                 /* the solution store, if any */
+  int appending;               /* add the batch to the store */
+  unsigned char *stored;       /* the store, mapped */
+  long stored_size;
+  struct keeper keep;          /* the puzzles to add to it */
+  long generate;               /* number of puzzles to make, if any */
+  int sym;                     /* the symmetry of their clues */
+  int target;                  /* and the most clues they can have */
+  long steps;                  /* steps of the walk to each grid, or -1 for the default */
+  int hunting;                 /* most clues of the minimal puzzles to hunt, if any */
+  int least;                   /* and the fewest */
+  unsigned long long seed;     /* for making them */
+  struct output *o;
+  struct solver *s;
+  FILE *f;
+  char *colon;
+  int opt,solved;
+
+  description = NULL;
+  lines = 0;
+  format = -1;
+  threads = 1;
+  number = 0;
+  indexing = 0;
+  convert = 0;
+  zip = ZIP_NONE;
+  memset(&budget, 0, sizeof(budget));
+  cached = 0;
+  store = NULL;
+  appending = 0;
+  stored = NULL;
+  stored_size = 0;
+  memset(&keep, 0, sizeof(keep));
+  generate = 0;
+  sym = SYM_NONE;
+  target = 0;
+  steps = -1;
+  hunting = 0;
+  least = 1;
+  seed = (unsigned long long) time(NULL) ^ ((unsigned long long) getpid() << 32);
+  while ((opt = getopt(argc, argv, "a:b:C:cd:g:j:klm:n:o:r:s:t:u:w:xy:z:")) != -1) {
+    switch (opt) {
+    case 'a':
+      lines = 1;
+      appending = 1;
+      store = optarg;
+      break;
+    case 'b':
+      budget.nodes = atol(optarg);
+      break;
+    case 'C':
+      if ((cached = atol(optarg)) > 0) break;
+      format = -2;
+      break;
+    case 'c':
+      lines = 1;
+      convert = CONVERT_COPY;
+      break;
+    case 'd':
+      description = optarg;
+      break;
+    case 'g':
+      lines = 1;
+      if ((generate = atol(optarg)) > 0) break;
+      format = -2;
+      break;
+    case 'j':
+      /* -j 0 is a thread for every processor */
+      threads = atoi(optarg);
+      if (threads < 1) threads = sysconf(_SC_NPROCESSORS_ONLN);
+      if (threads < 1) threads = 1;
+      break;
+    case 'k':
+      lines = 1;
+      convert = CONVERT_CANON;
+      break;
+    case 'l':
+      lines = 1;
+      break;
+    case 'm':
+      target = atoi(optarg);
+      break;
+    case 'n':
+      lines = 1;
+      if ((number = atol(optarg)) > 0) break;
+      format = -2;
+      break;
+    case 'r':
+      seed = strtoull(optarg, NULL, 0);
+      break;
+    case 's':
+      store = optarg;
+      break;
+    case 't':
+      budget.msecs = atol(optarg);
+      break;
+    case 'u':
+      lines = 1;
+      least = 1;
+      hunting = atoi(optarg);
+      if ((colon = strchr(optarg, ':')) != NULL) {
+        least = hunting;
+        hunting = atoi(colon + 1);
+      }
+      if ((least > 0) && (hunting >= least)) break;
+      format = -2;
+      break;
+    case 'w':
+      if ((steps = atol(optarg)) >= 0) break;
+      format = -2;
+      break;
+    case 'x':
+      indexing = 1;
+      break;
+    case 'y':
+      if (strcmp(optarg, "none") == 0) sym = SYM_NONE;
+      else if (strcmp(optarg, "rotate") == 0) sym = SYM_ROTATE;
+      else if (strcmp(optarg, "mirror") == 0) sym = SYM_MIRROR;
+      else if (strcmp(optarg, "diagonal") == 0) sym = SYM_DIAGONAL;
+      else format = -2;
+      break;
+    case 'z':
+      if (strcmp(optarg, "gzip") == 0) zip = ZIP_GZIP;
+      else if (strcmp(optarg, "zstd") == 0) zip = ZIP_ZSTD;
+      else format = -2;
+      break;
+    case 'o':
+      if (strcmp(optarg, "grid") == 0) format = OUT_GRID;
+      else if (strcmp(optarg, "line") == 0) format = OUT_LINE;
+      else if (strcmp(optarg, "csv") == 0) format = OUT_CSV;
+      else if (strcmp(optarg, "pack") == 0) format = OUT_PACK;
+      else if (strcmp(optarg, "rate") == 0) format = OUT_RATE;
+      else format = -2;
+      break;
+    default:
+      format = -2;
+    }
+  }
+  if ((format == -2) || (indexing && (optind >= argc))) {
+    fprintf(stderr, "usage: %s [-l] [-c|-k] [-j threads] [-n number] [-b nodes] [-t msecs] [-C entries] [-s store|-a store] [-o grid|line|csv|pack|rate] [-z gzip|zstd] [-d description] [puzzle file]\n"
+                    "       %s -g number [-j threads] [-m clues] [-y none|rotate|mirror|diagonal] [-w steps] [-r seed] [-o grid|line|csv|pack|rate] [-z gzip|zstd] [-d description]\n"
+                    "       %s -u [fewest:]clues [-j threads] [-o grid|line|csv|pack|rate] [-z gzip|zstd] [-d description] [grid file]\n"
+                    "       %s -x [-d description] packed file\n", argv[0], argv[0], argv[0], argv[0]);
+    exit(1);
+  }
+
+  /* puzzles come from a file if one is named, standard input if not */
+  if ((optind < argc) && (freopen(argv[optind], "r", stdin) == NULL)) {
+    printf("Failed to open %s.\n", argv[optind]);
+    exit(1);
+  }
+
+  /* build the constraint graph, the classic rules unless told otherwise */
+  gr = new_graph(ROWS, COLS);
+  if (gr == NULL) {
+    printf("Failed to allocate the puzzle.\n");
+    exit(1);
+  }
+  if (description != NULL) {
+    if ((f = fopen(description, "r")) == NULL) {
+      printf("Failed to open %s.\n", description);
+      exit(1);
+    }
+    if (!read_description(gr, f)) {
+      printf("Failed to read: invalid description file.\n");
+      exit(1);
+    }
+    fclose(f);
+  }
+  else if (!line_units(gr, 0, 0) || !box_units(gr, 0, 0)) {
+    printf("Failed to allocate the puzzle.\n");
+    exit(1);
+  }
+  if (!compile_graph(gr)) {
+    printf("Failed to allocate the puzzle.\n");
+    exit(1);
+  }
+
+  if ((convert == CONVERT_CANON) && !classic_rules(gr)) {
+    printf("Failed to canonise: only the classic rules have a canonical form.\n");
+    exit(1);
+  }
+  if ((store != NULL) && !classic_rules(gr)) {
+    printf("Failed to open %s: only the classic rules have a solution store.\n", store);
+    exit(1);
+  }
+
+  if ((sym == SYM_DIAGONAL) && (gr->rows != gr->cols)) {
+    printf("Failed to generate: diagonal symmetry needs a square grid.\n");
+    exit(1);
+  }
+  if ((format == OUT_RATE) && (MAX_VAL > 63)) {
+    printf("Failed to rate: grids of more than 63 values can't be rated.\n");
+    exit(1);
+  }
+
+  /* indexing a packed file doesn't solve anything */
+  if (indexing) {
+    if (!write_index(gr, argv[optind])) {
+      printf("Failed to index %s.\n", argv[optind]);
+      exit(1);
+    }
+    exit(0);
+  }
+
+  if (((ig = new_grid(gr)) == NULL) || ((og = new_grid(gr)) == NULL)
+      || ((s = new_solver(gr)) == NULL)) {
+    printf("Failed to allocate the puzzle.\n");
+    exit(1);
+  }
+  s->budget = budget;
+  /* appending needs a cache, to learn the canonical form of what it solves */
+  if (appending && (cached == 0)) cached = STORE_CACHE;
+  if ((cached > 0) && classic_rules(gr) && ((s->cache = sud_cache_new(cached)) == NULL)) {
+    printf("Failed to allocate the cache.\n");
+    exit(1);
+  }
+  /* a store to append to needn't exist yet */
+  if ((store != NULL) && ((stored = map_store(store, &stored_size)) == NULL)
+      && (!appending || (access(store, F_OK) == 0))) {
+    printf("Failed to open %s as a store for this size of grid.\n", store);
+    exit(1);
+  }
+  if (stored != NULL) {
+    s->store = stored + STORE_HEADER;
+    s->store_slots = check_store(stored, stored_size);
+  }
+
+  /* batches are written a line at a time, unless asked otherwise */
+  if (format < 0) {
+    format = lines ? OUT_LINE : OUT_GRID;
+  }
+  if ((o = new_output(1, format, (long) OUT_BUFFER)) == NULL) {
+    printf("Failed to allocate the output.\n");
+    exit(1);
+  }
+  if ((zip != ZIP_NONE) && !out_zip(o, zip)) {
+    printf("Failed to compress the output: not in this build.\n");
+    exit(1);
+  }
+  if (format == OUT_PACK) {
+    o->len = pack_header(gr, (unsigned char *) o->buf);
+  }
+
+  if (generate > 0) {
+    if (steps < 0) steps = WALK_STEPS(gr);
+    solved = generate_puzzles(gr, o, generate, threads, sym, target, steps, seed);
+    exit(out_close(o) && solved ? 0 : 1);
+  }
+  if (hunting > 0) {
+    solved = hunt_lines(s, ig, og, fileno(stdin), o, threads, least, hunting);
+    exit(out_close(o) && solved ? 0 : 1);
+  }
+  if (number > 0) {
+    solved = solve_number(s, ig, og, fileno(stdin), optind < argc ? argv[optind] : NULL, o, number);
+    exit(out_close(o) && solved ? 0 : 1);
+  }
+  if (lines && (threads > 1) && !convert && !appending) {
+    solved = solve_pipeline(gr, fileno(stdin), o, threads, s);
+    exit(out_close(o) && solved ? 0 : 1);
+  }
+  if (lines) {
+    solved = solve_lines(s, ig, og, fileno(stdin), o, convert, appending ? &keep : NULL);
+    if (appending && !write_store(store, stored, stored_size, &keep)) {
+      printf("Failed to write %s.\n", store);
+      exit(1);
+    }
+    exit(out_close(o) && solved ? 0 : 1);
+  }
+
+  if (!read_grid(ig)) {
+    printf("Failed to read: invalid input file.\n");
+    exit(1);
+  }
+
+  /* print the input grid, and the output grid if try succeeds, or say that we
+  ** failed to solve the sudoku */
+  solved = solve_grid(s, ig, og);
+  out_result(o, ig, og, NULL, 0L, solved);
+  exit(out_close(o) && solved ? 0 : 1);
+}
 
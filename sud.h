@@ -0,0 +1,252 @@
+/********************************************************************************
+*** libsud: the sudoku solving engine of sud as a library.
+*** Copyright 2021 Adam Jaworski.
+*** MIT License
+***
+*** A solver solves one puzzle at a time, written as a line: one character for
+*** each cell, row by row, with the digit for a clue and a dot (.) or 0 for
+*** unknown (numbers separated by spaces for grids of more than 9 values). The
+*** library has no global state and never does any I/O or exits, so any number
+*** of threads can solve at once, as long as each has a solver of its own.
+********************************************************************************/
+#ifndef SUD_H
+#define SUD_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* what sud_solve() returns */
+#define SUD_SOLVED 0           /* the solution is in the output buffer */
+#define SUD_UNSOLVABLE 1       /* the puzzle has no solution */
+#define SUD_INVALID 2          /* the input isn't a puzzle */
+#define SUD_NO_MEMORY 3        /* ran out of memory */
+#define SUD_NO_ROOM 4          /* the output buffer is too small */
+#define SUD_BUDGET 5           /* the search went over its budget */
+#define SUD_CANCELLED 6        /* the search was cancelled by sud_cancel() */
+
+struct sud_solver;
+
+/* how much work the last sud_solve() took */
+struct sud_stats {
+  long nodes;                  /* grids tried */
+  long guesses;                /* guesses made */
+  int depth;                   /* deepest level of the search */
+  long dead_ends;              /* grids found in the table of dead ends */
+};
+
+/* limits on the search for each puzzle, 0 for no limit */
+struct sud_budget {
+  long nodes;                  /* most grids to try */
+  long msecs;                  /* most milliseconds of wall clock time */
+  int depth;                   /* deepest level of the search */
+};
+
+/* Makes a solver for the classic rules, at the size the library was built for,
+** with all the memory it needs to solve. Returns NULL if there's no memory. */
+struct sud_solver *sud_new(void);
+
+/* Frees a solver and everything it holds. */
+void sud_free(struct sud_solver *s);
+
+/* The room sud_solve() needs for a solution: the longest line and a NUL. */
+size_t sud_line_size(struct sud_solver *s);
+
+/* Solves the puzzle in the n characters at in, and writes the solution into out
+** as a line ending in a NUL. Returns SUD_SOLVED or why not. */
+int sud_solve(struct sud_solver *s, const char *in, size_t n, char *out, size_t room);
+
+/* Counts the solutions of the puzzle in the n characters at in, up to limit of
+** them (all of them if limit is 0), into *count. Returns SUD_SOLVED if there
+** are any, SUD_UNSOLVABLE if none, or why the count didn't finish, with *count
+** the solutions found so far. */
+int sud_count(struct sud_solver *s, const char *in, size_t n, long limit, long *count);
+
+/* Rates how hard the puzzle in the n characters at in is for a person, by the
+** techniques it takes to solve it without guessing, into *rating: in tenths on
+** the scale of Sudoku Explainer, from 12 (1.2) for hidden singles to 100 when
+** nothing short of guessing will do, and 0 for a full grid. The name of the
+** hardest technique goes into *technique, unless it's NULL. Returns SUD_SOLVED,
+** SUD_UNSOLVABLE if the techniques find a contradiction, or SUD_INVALID if the
+** puzzle can't be read or the grid has more than 63 values. A puzzle with more
+** than one solution comes to guessing in the end. */
+int sud_rate(struct sud_solver *s, const char *in, size_t n, int *rating, const char **technique);
+
+/* the easiest deduction to make next in a puzzle, as found by sud_hint() */
+struct sud_hint {
+  const char *name;            /* the technique, as sud_rate() names them */
+  int rating;                  /* and its rating, as sud_rate() gives it */
+  int cell;                    /* the cell it fills in, or -1 if it takes out candidates, */
+  int value;                   /* and the value that goes there */
+  int nremoved;                /* the number of cells it takes candidates out of, */
+  const int *removed;          /* those cells, */
+  const unsigned long long *removed_values;  /* and the values each loses, bit v for value v */
+  int ncells;                  /* the number of cells it comes from, */
+  const int *cells;            /* and those cells */
+};
+
+/* Finds the easiest deduction to make next in the puzzle in the n characters
+** at in, a partly filled in grid, into *h: tries the techniques of sud_rate()
+** easiest first and stops at the first place one gets anywhere. The candidates
+** are the values no filled in peer has. Cells count from 0 in the order of the
+** puzzle line. The name is "Guessing", and there's no deduction, if nothing
+** short of guessing gets anywhere, and "None" for a full grid. The arrays are
+** the solver's, good until its next call. Returns SUD_SOLVED, SUD_UNSOLVABLE
+** if the techniques find a contradiction, or SUD_INVALID as sud_rate(). */
+int sud_hint(struct sud_solver *s, const char *in, size_t n, struct sud_hint *h);
+
+/* A board for an interactive front end: a puzzle being filled in by hand, a
+** cell at a time, which keeps track of the values each empty cell can still
+** take so that a change costs about as much as the cells it touches, not a
+** solve. Cells count from 0 in the order of the puzzle line. Like a solver, a
+** board is for one thread at a time, and boards share nothing. */
+struct sud_board;
+
+/* Makes an empty board for the classic rules. Returns NULL if there's no memory. */
+struct sud_board *sud_board_new(void);
+
+/* Frees a board. */
+void sud_board_free(struct sud_board *b);
+
+/* Sets the board to the puzzle in the n characters at in, whose clues can't be
+** erased. Returns SUD_SOLVED, or SUD_INVALID (leaving the board empty) if it
+** isn't a puzzle or two clues clash. */
+int sud_board_load(struct sud_board *b, const char *in, size_t n);
+
+/* Fills in value in an empty cell, taking it out of the values left in the
+** cell's rows, columns and boxes. Returns SUD_SOLVED, SUD_INVALID if the
+** cell is filled in or the value is already in one of them, or SUD_NO_MEMORY. */
+int sud_board_place(struct sud_board *b, int cell, int value);
+
+/* Empties a cell filled in by sud_board_place(), giving its value back to the
+** cells around it. Returns SUD_SOLVED, SUD_INVALID for a clue, or SUD_NO_MEMORY. */
+int sud_board_erase(struct sud_board *b, int cell);
+
+/* The value in a cell, or 0 if it's empty. */
+int sud_board_value(struct sud_board *b, int cell);
+
+/* The number of values an empty cell can still take, given the cells filled
+** in, and 0 for a cell filled in. If values isn't NULL they go there, in
+** order, so it needs room for as many values as the grid has. */
+int sud_board_candidates(struct sud_board *b, int cell, int *values);
+
+/* Whether the board can still be solved: returns SUD_SOLVED if it can,
+** SUD_UNSOLVABLE if not, or why the search gave up: SUD_NO_MEMORY, SUD_BUDGET
+** or SUD_CANCELLED. A solution found before is reused for as long as the cells
+** filled in since agree with it, so it only searches after a move that goes
+** against it. */
+int sud_board_solvable(struct sud_board *b);
+
+/* Sets the budget for each search of sud_board_solvable(), as sud_set_budget(). */
+void sud_board_set_budget(struct sud_board *b, const struct sud_budget *bu);
+
+/* Stops the search of sud_board_solvable() running on the board, as sud_cancel(). */
+void sud_board_cancel(struct sud_board *b);
+
+/* Gives the solver a table of at least entries grids proven to have no solution,
+** which it keeps from one puzzle to the next, so that it doesn't search them
+** again; or takes it away if entries is 0. Worth having when the puzzles share
+** much of their search, as when checking that each of a series of puzzles made
+** by adding or taking away clues has just one solution. The puzzles have to be
+** made of clues alone, which is all sud_solve() and sud_count() take.
+** Returns 1, or 0 if there's no memory. */
+int sud_set_dead_ends(struct sud_solver *s, long entries);
+
+/* A cache of solutions, which any number of solvers and pools can share.
+** Puzzles that take more than a short search are looked up by their canonical
+** form, so a puzzle seen before in any of its symmetries isn't solved again. */
+struct sud_cache;
+
+/* Makes a cache holding up to entries puzzles. Returns NULL if there's no memory. */
+struct sud_cache *sud_cache_new(long entries);
+
+/* Frees a cache, once no solver or pool uses it. */
+void sud_cache_free(struct sud_cache *c);
+
+/* Has sud_solve() go through the cache from now on, or not if c is NULL. */
+void sud_set_cache(struct sud_solver *s, struct sud_cache *c);
+
+/* Has sud_solve() look up puzzles in the solution store of n characters at p,
+** as written by sud -a and mapped by the caller, after the cache and before
+** solving them; or not if p is NULL. The store must stay mapped while in use.
+** Returns 1, or 0 if it isn't a store for this size of grid. */
+int sud_set_store(struct sud_solver *s, const void *p, size_t n);
+
+/* The number of times a cache has been looked up and found and not found. */
+void sud_cache_stats(struct sud_cache *c, long *hits, long *misses);
+
+/* Writes the canonical form of the puzzle in the n characters at in into out,
+** as a line ending in a NUL: the same line for every puzzle that's the same but
+** for permuting bands, rows within bands, stacks and columns within stacks,
+** transposing and relabelling the values. Works for solutions too. Returns
+** SUD_SOLVED or why not. */
+int sud_canonical(struct sud_solver *s, const char *in, size_t n, char *out, size_t room);
+
+/* Fills in the statistics of the last sud_solve(). */
+void sud_stats(struct sud_solver *s, struct sud_stats *st);
+
+/* Sets the budget for each sud_solve() from now on, or none if b is NULL. A
+** solve that goes over it gives up with SUD_BUDGET. */
+void sud_set_budget(struct sud_solver *s, const struct sud_budget *b);
+
+/* Stops the solve running on the solver, which gives up with SUD_CANCELLED.
+** Safe to call from any thread. If no solve is running it stops the next one. */
+void sud_cancel(struct sud_solver *s);
+
+/* A message for a status returned by sud_solve(). */
+const char *sud_status_text(int status);
+
+/* A pool of threads solving puzzles in the background. Each result goes to the
+** callback submitted with it, called on the thread that solved it, or without a
+** callback onto a completion queue read by sud_poll() and sud_wait(). */
+struct sud_pool;
+
+typedef void (*sud_callback)(long ticket, int status, void *arg);
+
+/* a result from the completion queue */
+struct sud_result {
+  long ticket;                 /* what sud_submit() returned for the puzzle */
+  int status;                  /* as sud_solve() returns */
+  void *arg;                   /* as given to sud_submit() */
+};
+
+/* Makes a pool of solvers for the classic rules on the number of threads, or
+** one for each processor if threads is 0. Returns NULL if it can't. */
+struct sud_pool *sud_pool_new(int threads);
+
+/* Stops the threads and frees the pool, dropping any puzzles not yet solved
+** and cancelling those being solved. */
+void sud_pool_free(struct sud_pool *p);
+
+/* Queues the puzzle in the n characters at in (which is copied, so needn't be
+** kept) to be solved into out, which must be kept until the result comes.
+** Returns a ticket for the puzzle, counting from 1, or -1 if there's no memory. */
+long sud_submit(struct sud_pool *p, const char *in, size_t n, char *out, size_t room,
+                sud_callback cb, void *arg);
+
+/* Takes the next result off the completion queue into r. Returns 1 if there
+** was one, 0 if not. sud_wait() waits for one, and returns 0 only if none are
+** still to come. Results come in the order they're solved, not submitted. */
+int sud_poll(struct sud_pool *p, struct sud_result *r);
+int sud_wait(struct sud_pool *p, struct sud_result *r);
+
+/* An eventfd that's readable while results are waiting on the completion queue,
+** for poll() or epoll. Leave reading it to sud_poll(). */
+int sud_pool_fd(struct sud_pool *p);
+
+/* Sets the budget for each puzzle taken from now on, as sud_set_budget(). */
+void sud_pool_budget(struct sud_pool *p, const struct sud_budget *b);
+
+/* Has the pool's threads go through the cache from now on, as sud_set_cache(). */
+void sud_pool_cache(struct sud_pool *p, struct sud_cache *c);
+
+/* Has the pool's threads look up the solution store, as sud_set_store(). */
+int sud_pool_store(struct sud_pool *p, const void *q, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,250 @@
+/********************************************************************************
+*** sud.hpp: a C++ front end to the sudoku solver of sud.h.
+*** Copyright 2021 Adam Jaworski.
+*** MIT License
+***
+*** The engine is libsud's, so a puzzle solves the same, with the same budgets,
+*** cancelling and statuses, as through sud.h or the sud program; this puts
+*** std::span and a solver that frees itself in front of it. The size of the
+*** boxes is a pair of template parameters, which has to be the size libsud was
+*** built for, and the units and peers of that size are worked out by constexpr
+*** functions at compile time, for a program that works on the grid itself.
+*** Needs C++20, for std::span. With libsud.o built as libsud.c says:
+***   c++ -std=c++20 -O2 -pthread program.cpp libsud.o
+***
+***   sud::solver<3, 3> s;
+***   char out[sud::solver<3, 3>::line_size];
+***   if (s.solve(puzzle, out) == sud::status::solved) ...
+***
+*** test_hpp.cpp solves a batch with it, to check against what sud writes.
+********************************************************************************/
+#ifndef SUD_HPP
+#define SUD_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <span>
+
+#include "sud.h"
+
+namespace sud {
+
+/* what a solve returns, with the values of the SUD_ codes of sud.h */
+enum class status {
+  solved = SUD_SOLVED,
+  unsolvable = SUD_UNSOLVABLE,
+  invalid = SUD_INVALID,
+  no_memory = SUD_NO_MEMORY,
+  no_room = SUD_NO_ROOM,
+  budget = SUD_BUDGET,
+  cancelled = SUD_CANCELLED
+};
+
+using budget = struct sud_budget;  /* limits on each solve, 0 for none */
+using stats = struct sud_stats;    /* the work of a solve */
+
+
+/********************************************************************************
+*** The layout of a classic grid made of R x C boxes: its units (rows, columns
+*** and boxes), the box of every cell and the peers of every cell. Cells are
+*** numbered row by row, as in libsud.c.
+********************************************************************************/
+template <int R, int C>
+struct layout {
+  static_assert(R > 0 && C > 0, "boxes of at least a cell");
+
+  static constexpr int values = R*C;
+  static constexpr int size = values;                  /* rows, and columns */
+  static constexpr int cells = size*size;
+  static constexpr int units = 3*size;
+  static constexpr int npeers = 2*(size - 1) + (R - 1)*(C - 1);
+
+  static constexpr int row_of(int i) { return i / size; }
+  static constexpr int col_of(int i) { return i % size; }
+  static constexpr int box_of(int i) { return row_of(i) / R * R + col_of(i) / C; }
+
+  static constexpr auto make_units()
+  {
+    std::array<std::array<int, size>, units> u{};
+    for (int k=0; k<size; k++) {
+      for (int j=0; j<size; j++) {
+        u[k][j] = k*size + j;                                        /* row k */
+        u[size + k][j] = j*size + k;                                 /* column k */
+        u[2*size + k][j] = (k/R*R + j/C)*size + k%R*C + j%C;         /* box k */
+      }
+    }
+    return u;
+  }
+
+  static constexpr auto make_box_index()
+  {
+    std::array<int, cells> b{};
+    for (int i=0; i<cells; i++) {
+      b[i] = box_of(i);
+    }
+    return b;
+  }
+
+  static constexpr auto make_peers()
+  {
+    std::array<std::array<int, npeers>, cells> p{};
+    for (int i=0; i<cells; i++) {
+      int n = 0;
+      for (int j=0; j<cells; j++) {
+        if ((j != i) && ((row_of(j) == row_of(i)) || (col_of(j) == col_of(i))
+                         || (box_of(j) == box_of(i)))) {
+          p[i][n++] = j;
+        }
+      }
+    }
+    return p;
+  }
+
+  static constexpr auto unit_table = make_units();
+  static constexpr auto box_index = make_box_index();
+  static constexpr auto peers = make_peers();
+};
+
+
+/********************************************************************************
+*** A solver for grids of R x C boxes: a libsud solver, built with R_ROWS=R and
+*** R_COLS=C, held by a unique_ptr that frees it. There is one engine, in
+*** libsud.c, and this only gives it spans and types; a solver made against a
+*** library built for another size is empty, as is one there was no memory for,
+*** and every call on it returns status::invalid or status::no_memory. Puzzles
+*** are lines as sud_solve() reads them, and trailing white space is ignored,
+*** so a batch can be records of lines padded out. Like a libsud solver, one
+*** solver is for one thread at a time, but cancel() can come from any thread.
+********************************************************************************/
+template <int R, int C>
+class solver {
+public:
+  using grid_layout = layout<R, C>;
+  static constexpr int values = grid_layout::values;
+  static constexpr int cells = grid_layout::cells;
+
+  /* the longest solution line and its NUL, as sud_line_size() */
+  static constexpr std::size_t line_size = (values <= 9 ? 1 : 4)*cells + 1;
+
+  solver() : s_(sud_new(), &sud_free), made_(status::no_memory)
+  {
+    if (s_ == nullptr) {
+      return;
+    }
+    made_ = status::solved;
+    if (sud_line_size(s_.get()) != line_size) {
+      s_.reset();
+      made_ = status::invalid;
+    }
+  }
+
+  /* whether the solver can be used: status::solved, or why it's empty */
+  status made() const { return made_; }
+  explicit operator bool() const { return s_ != nullptr; }
+
+  /* Solves one puzzle, and writes the solution line into out followed by NULs
+  ** to the end of out. */
+  status solve(std::span<const char> in, std::span<char> out)
+  {
+    std::size_t n;
+    status st;
+    if (s_ == nullptr) {
+      return made_;
+    }
+    in = trim(in);
+    st = status(sud_solve(s_.get(), in.data(), in.size(), out.data(), out.size()));
+    if (st == status::solved) {
+      for (n=std::strlen(out.data()); n<out.size(); n++) {
+        out[n] = '\0';
+      }
+    }
+    return st;
+  }
+
+  /* Solves a batch of puzzles, each in a record of in_stride characters of in
+  ** (a line padded with white space), writing each solution into the next
+  ** out_stride characters of out and its status into st.
+  ** Returns the number solved. */
+  std::size_t solve(std::span<const char> in, std::size_t in_stride,
+                    std::span<char> out, std::size_t out_stride, std::span<status> st)
+  {
+    std::size_t k,n,solved;
+    n = in_stride ? in.size() / in_stride : 0;
+    if (out_stride && (out.size() / out_stride < n)) n = out.size() / out_stride;
+    if (st.size() < n) n = st.size();
+    for (solved=0, k=0; k<n; k++) {
+      st[k] = solve(in.subspan(k*in_stride, in_stride), out.subspan(k*out_stride, out_stride));
+      if (st[k] == status::solved) solved++;
+    }
+    return solved;
+  }
+
+  /* Counts the solutions of a puzzle up to limit (0 for all) into count, as
+  ** sud_count(). */
+  status count(std::span<const char> in, long limit, long &count)
+  {
+    count = 0;
+    if (s_ == nullptr) {
+      return made_;
+    }
+    in = trim(in);
+    return status(sud_count(s_.get(), in.data(), in.size(), limit, &count));
+  }
+
+  /* Writes the canonical form of a puzzle into out as a line ending in a NUL,
+  ** as sud_canonical(). */
+  status canonical(std::span<const char> in, std::span<char> out)
+  {
+    if (s_ == nullptr) {
+      return made_;
+    }
+    in = trim(in);
+    return status(sud_canonical(s_.get(), in.data(), in.size(), out.data(), out.size()));
+  }
+
+  /* Sets the budget of each solve from now on, after which it gives up with
+  ** status::budget; no_budget() takes it away. */
+  void set_budget(const budget &b) { if (s_ != nullptr) sud_set_budget(s_.get(), &b); }
+  void no_budget() { if (s_ != nullptr) sud_set_budget(s_.get(), nullptr); }
+
+  /* Stops the solve running, or else the next one, with status::cancelled. */
+  void cancel() { if (s_ != nullptr) sud_cancel(s_.get()); }
+
+  /* the work of the last solve */
+  stats last_stats()
+  {
+    stats st{};
+    if (s_ != nullptr) sud_stats(s_.get(), &st);
+    return st;
+  }
+
+  /* the libsud solver, for the calls of sud.h not wrapped here */
+  sud_solver *get() { return s_.get(); }
+
+private:
+  std::unique_ptr<sud_solver, decltype(&sud_free)> s_;
+  status made_;
+
+  static std::span<const char> trim(std::span<const char> in)
+  {
+    std::size_t n = in.size();
+    while ((n > 0) && ((in[n-1] == ' ') || (in[n-1] == '\n') || (in[n-1] == '\r')
+                       || (in[n-1] == '\t') || (in[n-1] == '\0'))) {
+      n--;
+    }
+    return in.first(n);
+  }
+};
+
+
+/* a message for a status, as sud_status_text() */
+inline const char *text(status st)
+{
+  return sud_status_text(int(st));
+}
+
+}
+
+#endif
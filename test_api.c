@@ -0,0 +1,312 @@
+/********************************************************************************
+*** A check of the interface of libsud in sud.h against answers known from
+*** elsewhere: the puzzles and solutions of l1.txt and l1.out, the candidates of
+*** a board worked out here from its cells, and the ratings Sudoku Explainer
+*** gives. Build with libsud.o built as libsud.c says, from the top of the tree:
+***   cc -O2 -pthread -c libsud.c
+***   cc -O2 -pthread -o test_api test_api.c libsud.o
+***   ./test_api
+*** which writes what failed, if anything, and exits 0 if nothing did.
+*** Copyright 2021 Adam Jaworski.
+*** MIT License
+********************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sud.h"
+
+#define CELLS 81
+#define LINES 15
+#define LINE_ROOM 100
+
+/* the first two puzzles of l1.txt, a plain one and a hard one */
+static const char *easy = ".75...31.4..537..63.......5.1.4.6.3..2.....5..4.8.3.7.1.......98..291..7.52...18.";
+static const char *easy_solution = "275968314491537826386142795718456932623719458549823671167385249834291567952674183";
+static const char *hard = "........1.......23..4..5......1.........3.6....7...58.....67....1...4...52.......";
+static const char *hard_solution = "672983451951476823384215976468159237295738614137642589843567192719824365526391748";
+static const char *empty = ".................................................................................";
+static const char *clash = "11...............................................................................";
+
+static int failures;
+
+
+/********************************************************************************
+*** Notes a check that failed.
+********************************************************************************/
+static void
+check(ok, what)
+  int ok;
+  const char *what;
+{
+  if (ok) return;
+  printf("Failed: %s.\n", what);
+  failures++;
+}
+
+
+/********************************************************************************
+*** Works out the values cell i of the puzzle line p can take, from its filled
+*** in peers alone, into values. Returns the number of them, or 0 if it's filled.
+********************************************************************************/
+static int
+peer_candidates(p, i, values)
+  const char *p;
+  int i;
+  int *values;
+{
+  int used[10];
+  int j,v,n;
+
+  if (p[i] != '.') {
+    return 0;
+  }
+  memset(used, 0, sizeof(used));
+  for (j=0; j<CELLS; j++) {
+    if ((p[j] == '.') || ((j/9 != i/9) && (j%9 != i%9) && ((j/27 != i/27) || (j%9/3 != i%9/3)))) continue;
+    used[p[j] - '0'] = 1;
+  }
+  for (n=0, v=1; v<=9; v++) {
+    if (!used[v]) values[n++] = v;
+  }
+  return n;
+}
+
+
+/********************************************************************************
+*** Checks the candidates of every cell of the board against those worked out
+*** from the puzzle line p it should hold.
+********************************************************************************/
+static int
+board_agrees(b, p)
+  struct sud_board *b;
+  const char *p;
+{
+  int want[9],got[9];
+  int i,n;
+
+  for (i=0; i<CELLS; i++) {
+    n = peer_candidates(p, i, want);
+    if ((sud_board_value(b, i) != (p[i] == '.' ? 0 : p[i] - '0'))
+        || (sud_board_candidates(b, i, got) != n)
+        || (memcmp(want, got, n * sizeof(int)) != 0)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+
+static void
+test_board()
+{
+  struct sud_board *b;
+  char p[CELLS + 1];
+  int values[9];
+  int i,n,wrong;
+
+  b = sud_board_new();
+  check(b != NULL, "to make a board");
+  if (b == NULL) return;
+  strcpy(p, easy);
+  check(sud_board_load(b, p, CELLS) == SUD_SOLVED, "to load a board");
+  check(board_agrees(b, p), "to load the candidates of a board");
+  check(sud_board_solvable(b) == SUD_SOLVED, "to find a loaded board solvable");
+
+  /* fill in cell 0 and then cell 3 of the same row, and erase cell 0 again:
+  ** the undo log has to bring back all that cell 0 took, and keep cell 3's */
+  check(sud_board_place(b, 0, easy_solution[0] - '0') == SUD_SOLVED, "to fill in a cell");
+  p[0] = easy_solution[0];
+  check(board_agrees(b, p), "to take a value filled in from its peers");
+  check(sud_board_place(b, 3, easy_solution[3] - '0') == SUD_SOLVED, "to fill in a second cell");
+  p[3] = easy_solution[3];
+  check(board_agrees(b, p), "to take a second value from its peers");
+  check(sud_board_erase(b, 0) == SUD_SOLVED, "to erase a cell");
+  p[0] = '.';
+  check(board_agrees(b, p), "to give the values of an erased cell back from the undo log");
+  check(sud_board_solvable(b) == SUD_SOLVED, "to find a right move solvable");
+
+  check(sud_board_place(b, 1, 1) == SUD_INVALID, "to keep a clue from being filled in");
+  check(sud_board_erase(b, 1) == SUD_INVALID, "to keep a clue from being erased");
+  check(sud_board_place(b, 0, 7) == SUD_INVALID, "to keep out a value a peer has");
+
+  /* a value the peers allow but the solution doesn't */
+  n = sud_board_candidates(b, 4, values);
+  for (i=0, wrong=0; (i < n) && !wrong; i++) {
+    if (values[i] != easy_solution[4] - '0') wrong = values[i];
+  }
+  check(wrong > 0, "to find a wrong candidate");
+  check(sud_board_place(b, 4, wrong) == SUD_SOLVED, "to fill in a wrong value");
+  check(sud_board_solvable(b) == SUD_UNSOLVABLE, "to find a wrong move unsolvable");
+  check(sud_board_erase(b, 4) == SUD_SOLVED, "to erase a wrong value");
+  check(board_agrees(b, p), "to give a wrong value back");
+  check(sud_board_solvable(b) == SUD_SOLVED, "to find the board solvable again");
+
+  check(sud_board_load(b, "11", 2) == SUD_INVALID, "to refuse a line that isn't a puzzle");
+  sud_board_free(b);
+}
+
+
+static void
+test_solver(s)
+  struct sud_solver *s;
+{
+  struct sud_budget bu;
+  struct sud_stats st;
+  struct sud_hint h;
+  struct sud_cache *c;
+  char out[LINE_ROOM],one[CELLS + 1],turned[CELLS + 1],canon[LINE_ROOM];
+  const char *technique;
+  long count,hits,misses;
+  int i,rating;
+
+  check(sud_line_size(s) == CELLS + 1, "to give the room for a line");
+  check((sud_solve(s, easy, CELLS, out, sizeof(out)) == SUD_SOLVED) && (strcmp(out, easy_solution) == 0),
+        "to solve a puzzle");
+  sud_stats(s, &st);
+  check(st.nodes > 0, "to count the nodes of a solve");
+  check(sud_solve(s, easy, CELLS, out, CELLS) == SUD_NO_ROOM, "to want room for the NUL");
+  check(sud_solve(s, "not a puzzle", 12, out, sizeof(out)) == SUD_INVALID, "to refuse a line that isn't a puzzle");
+
+  check((sud_count(s, easy, CELLS, 0, &count) == SUD_SOLVED) && (count == 1), "to count one solution");
+  check((sud_count(s, empty, CELLS, 10, &count) == SUD_SOLVED) && (count == 10), "to stop counting at the limit");
+  check((sud_count(s, clash, CELLS, 0, &count) == SUD_UNSOLVABLE) && (count == 0), "to count no solutions of clashing clues");
+
+  /* Sudoku Explainer: 1.5 for a hidden single in a row or column, 1.2 in a box */
+  check((sud_rate(s, easy, CELLS, &rating, &technique) == SUD_SOLVED) && (rating == 15), "to rate a puzzle");
+  strcpy(one, easy_solution);
+  one[40] = '.';
+  check((sud_rate(s, one, CELLS, &rating, &technique) == SUD_SOLVED) && (rating == 12), "to rate a single empty cell");
+  check((sud_rate(s, easy_solution, CELLS, &rating, &technique) == SUD_SOLVED) && (rating == 0), "to rate a full grid");
+
+  check((sud_hint(s, one, CELLS, &h) == SUD_SOLVED) && (h.cell == 40) && (h.value == easy_solution[40] - '0'),
+        "to hint at a single empty cell");
+  check((sud_hint(s, easy, CELLS, &h) == SUD_SOLVED) && (h.cell >= 0) && (h.value == easy_solution[h.cell] - '0')
+        && (h.rating == 12) && (h.ncells > 0), "to hint at the right value");
+  check((sud_hint(s, easy_solution, CELLS, &h) == SUD_SOLVED) && (strcmp(h.name, "None") == 0), "to hint at nothing on a full grid");
+
+  /* a puzzle and its transpose have the same canonical form */
+  for (i=0; i<CELLS; i++) {
+    turned[i] = easy[i%9*9 + i/9];
+  }
+  turned[CELLS] = '\0';
+  check((sud_canonical(s, easy, CELLS, canon, sizeof(canon)) == SUD_SOLVED)
+        && (sud_canonical(s, turned, CELLS, out, sizeof(out)) == SUD_SOLVED) && (strcmp(canon, out) == 0),
+        "to give a transposed puzzle the same canonical form");
+
+  memset(&bu, 0, sizeof(bu));
+  bu.nodes = 1;
+  sud_set_budget(s, &bu);
+  check(sud_solve(s, hard, CELLS, out, sizeof(out)) == SUD_BUDGET, "to keep to a budget of nodes");
+  sud_set_budget(s, NULL);
+  check(sud_solve(s, hard, CELLS, out, sizeof(out)) == SUD_SOLVED, "to solve once the budget is gone");
+  sud_cancel(s);
+  check(sud_solve(s, hard, CELLS, out, sizeof(out)) == SUD_CANCELLED, "to cancel the next solve");
+  check(sud_solve(s, hard, CELLS, out, sizeof(out)) == SUD_SOLVED, "to solve after a cancel");
+
+  c = sud_cache_new(100);
+  check(c != NULL, "to make a cache");
+  if (c == NULL) return;
+  sud_set_cache(s, c);
+  check((sud_solve(s, hard, CELLS, out, sizeof(out)) == SUD_SOLVED) && (strcmp(out, hard_solution) == 0),
+        "to solve a hard puzzle through the cache");
+  check((sud_solve(s, turned, CELLS, out, sizeof(out)) == SUD_SOLVED), "to solve an easy puzzle through the cache");
+  check((sud_solve(s, hard, CELLS, out, sizeof(out)) == SUD_SOLVED) && (strcmp(out, hard_solution) == 0),
+        "to solve a hard puzzle from the cache");
+  sud_cache_stats(c, &hits, &misses);
+  check((hits == 1) && (misses == 1), "to find a hard puzzle in the cache the second time only");
+  sud_set_cache(s, NULL);
+  sud_cache_free(c);
+
+  check(strcmp(sud_status_text(SUD_BUDGET), "budget exceeded") == 0, "to give the text of a status");
+}
+
+
+/* counts the results that come to the callback */
+static void
+count_result(ticket, status, arg)
+  long ticket;
+  int status;
+  void *arg;
+{
+  (void) ticket;
+  if (status == SUD_SOLVED) ++*(long *) arg;
+}
+
+
+static void
+test_pool()
+{
+  struct sud_pool *p;
+  struct sud_result r;
+  FILE *f,*g;
+  char in[LINES][LINE_ROOM],want[LINES][LINE_ROOM],out[LINES][LINE_ROOM],extra[LINE_ROOM];
+  long tickets[LINES];
+  long called,results;
+  int n,k;
+
+  if (((f = fopen("l1.txt", "r")) == NULL) || ((g = fopen("l1.out", "r")) == NULL)) {
+    check(0, "to open l1.txt and l1.out");
+    return;
+  }
+  for (n=0; (n < LINES) && (fgets(in[n], LINE_ROOM, f) != NULL) && (fgets(want[n], LINE_ROOM, g) != NULL); n++) {
+    want[n][strcspn(want[n], "\n")] = '\0';
+  }
+  fclose(f);
+  fclose(g);
+  check(n == LINES, "to read every line of l1.txt and l1.out");
+
+  p = sud_pool_new(4);
+  check(p != NULL, "to make a pool");
+  if (p == NULL) return;
+  for (k=0; k<n; k++) {
+    out[k][0] = '\0';
+    tickets[k] = sud_submit(p, in[k], strcspn(in[k], "\r\n"), out[k], LINE_ROOM, NULL, &out[k]);
+    check(tickets[k] == k + 1, "to give tickets counting from 1");
+  }
+  for (results=0; sud_wait(p, &r); results++) {
+    k = (char (*)[LINE_ROOM]) r.arg - out;
+    check((k >= 0) && (k < n) && (r.ticket == tickets[k]), "to bring back the ticket and argument of a puzzle");
+    if ((k < 0) || (k >= n)) continue;
+    if (r.status != SUD_SOLVED) out[k][0] = '\0';
+    check(strcmp(out[k], want[k]) == 0, "to solve each puzzle of l1.txt in the pool as in l1.out");
+  }
+  check(results == n, "to bring back every result");
+  check(!sud_poll(p, &r), "to leave nothing on the queue");
+
+  sud_pool_free(p);
+
+  /* one thread takes the puzzles in turn, so the callbacks have all been
+  ** made once the result of the puzzle after them is on the queue */
+  p = sud_pool_new(1);
+  check(p != NULL, "to make a pool of one thread");
+  if (p == NULL) return;
+  called = 0;
+  sud_submit(p, easy, CELLS, extra, sizeof(extra), count_result, &called);
+  sud_submit(p, hard, CELLS, out[0], LINE_ROOM, count_result, &called);
+  sud_submit(p, easy, CELLS, out[1], LINE_ROOM, NULL, NULL);
+  check(sud_wait(p, &r) && (r.ticket == 3), "to send results with a callback to the callback only");
+  check(called == 2, "to call back with each result");
+  check((strcmp(extra, easy_solution) == 0) && (strcmp(out[0], hard_solution) == 0), "to solve the puzzles called back for");
+  sud_pool_free(p);
+}
+
+
+int
+main()
+{
+  struct sud_solver *s;
+
+  s = sud_new();
+  check(s != NULL, "to make a solver");
+  if (s != NULL) {
+    test_solver(s);
+    sud_free(s);
+  }
+  test_board();
+  test_pool();
+  if (failures > 0) {
+    printf("%d checks failed.\n", failures);
+    exit(1);
+  }
+  exit(0);
+}
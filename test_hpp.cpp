@@ -0,0 +1,82 @@
+/********************************************************************************
+*** A check of sud.hpp: solves a batch of puzzle lines with it, and writes the
+*** solution of each or an empty line, as sud -l does, so that
+***   cc -O2 -pthread -c libsud.c
+***   c++ -std=c++20 -O2 -pthread -o test_hpp test_hpp.cpp libsud.o
+***   ./test_hpp l1.txt | cmp - l1.out
+***   ./test_hpp -b 200 l1.txt | cmp - l1-budget.out
+*** should say nothing. Each puzzle is solved on its own and again in a batch of
+*** them all, padded out to records of the longest line, and the two have to
+*** agree; a cancel() made before a solve has to stop it.
+*** Copyright 2021 Adam Jaworski.
+*** MIT License
+********************************************************************************/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "sud.hpp"
+
+int
+main(int argc, char *argv[])
+{
+  sud::solver<3, 3> s;
+  sud::budget b{};
+  std::vector<std::string> lines;
+  std::string line;
+  std::size_t k,width,stride;
+  int a;
+
+  for (a=1; (a < argc-1) && (std::strcmp(argv[a], "-b") == 0); a+=2) {
+    b.nodes = std::atol(argv[a+1]);
+  }
+  if (a != argc-1) {
+    std::fprintf(stderr, "usage: %s [-b nodes] puzzle file\n", argv[0]);
+    return 1;
+  }
+  std::ifstream f(argv[a]);
+  if (!f) {
+    std::printf("Failed to open %s.\n", argv[a]);
+    return 1;
+  }
+  if (!s) {
+    std::printf("Failed to make a solver: %s.\n", sud::text(s.made()));
+    return 1;
+  }
+  s.set_budget(b);
+
+  width = 0;
+  while (std::getline(f, line)) {
+    lines.push_back(line);
+    if (line.size() > width) width = line.size();
+  }
+  std::vector<char> in(lines.size() * width, ' ');
+  for (k=0; k<lines.size(); k++) {
+    std::memcpy(&in[k*width], lines[k].data(), lines[k].size());
+  }
+  stride = s.line_size;
+  std::vector<char> out(lines.size() * stride);
+  std::vector<sud::status> st(lines.size());
+  s.solve(in, width, out, stride, st);
+
+  std::vector<char> one(stride);
+  for (k=0; k<lines.size(); k++) {
+    if ((s.solve(lines[k], one) != st[k])
+        || ((st[k] == sud::status::solved) && (std::memcmp(one.data(), &out[k*stride], stride) != 0))) {
+      std::printf("Failed to solve line %zu alike on its own and in the batch.\n", k + 1);
+      return 1;
+    }
+    std::printf("%s\n", st[k] == sud::status::solved ? &out[k*stride] : "");
+  }
+
+  s.cancel();
+  if ((lines.size() > 0) && (s.solve(lines[0], one) != sud::status::cancelled)) {
+    std::printf("Failed to cancel a solve.\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,176 @@
+/********************************************************************************
+*** A check that the random walk of sample_grid() gives near uniform grids.
+*** Copyright 2021 Adam Jaworski.
+*** MIT License
+***
+*** It works on 6x6 grids, few enough to count every one of them: there are
+*** 28,200,960. Every grid is counted for its unavoidable rectangles, the pairs
+*** of rows and pairs of columns whose four cells lie in two boxes and hold two
+*** values crosswise, which a uniform sampler has to match in proportion. Then
+*** SAMPLES grids are drawn as the generator draws them, and compared with that
+*** on a chi-squared test. Since a random transform can hide grids drawn alike,
+*** the rectangles (which no transform changes) of each grid drawn are also
+*** checked for any correlation with the grid drawn before it. The seed is
+*** fixed, so every run gives the same figures. Build and run with:
+***   cc -O2 -pthread -DR_ROWS=2 -DR_COLS=3 -o test_walk test_walk.c -lm
+***   ./test_walk [steps]
+*** which exits 0 if the grids pass, and 1 if not.
+********************************************************************************/
+#include <stdio.h>
+#include <math.h>
+
+#define SUD_PROGRAM
+#include "libsud.c"
+
+#if (R_ROWS != 2) || (R_COLS != 3)
+#error "test_walk needs -DR_ROWS=2 -DR_COLS=3"
+#endif
+
+#define SAMPLES 50000L
+#define MAX_RECTS 64
+#define CHI_Z 3.09             /* normal deviate of the 0.1% tail */
+
+
+/********************************************************************************
+*** Counts the unavoidable rectangles of a full grid of values v.
+********************************************************************************/
+int
+rectangles(v)
+  int *v;
+{
+  int r1,r2,c1,c2,n;
+
+  n = 0;
+  for (r1=0; r1<ROWS; r1++) {
+    for (r2=r1+1; r2<ROWS; r2++) {
+      for (c1=0; c1<COLS; c1++) {
+        for (c2=c1+1; c2<COLS; c2++) {
+          /* in two boxes: the rows in one band or the columns in one stack */
+          if ((r1/R_ROWS == r2/R_ROWS) == (c1/R_COLS == c2/R_COLS)) continue;
+          if ((v[r1*COLS + c1] == v[r2*COLS + c2]) && (v[r1*COLS + c2] == v[r2*COLS + c1])) n++;
+        }
+      }
+    }
+  }
+  return n;
+}
+
+
+/********************************************************************************
+*** Fills in every grid from cell k on, counting each full grid in counts by its
+*** rectangles. Returns the number of grids.
+********************************************************************************/
+long
+every_grid(v, k, counts)
+  int *v;
+  int k;
+  double *counts;
+{
+  int r,c,i,j,x,free;
+  long n;
+
+  if (k == ROWS*COLS) {
+    counts[rectangles(v)]++;
+    return 1;
+  }
+  r = k / COLS;
+  c = k % COLS;
+  n = 0;
+  for (x=1; x<=MAX_VAL; x++) {
+    free = 1;
+    for (i=0; (i<COLS) && free; i++) {
+      if ((v[r*COLS + i] == x) || (v[i*COLS + c] == x)) free = 0;
+    }
+    for (i=r-r%R_ROWS; (i<r-r%R_ROWS+R_ROWS) && free; i++) {
+      for (j=c-c%R_COLS; j<c-c%R_COLS+R_COLS; j++) {
+        if (v[i*COLS + j] == x) free = 0;
+      }
+    }
+    if (!free) continue;
+    v[k] = x;
+    n += every_grid(v, k + 1, counts);
+    v[k] = 0;
+  }
+  return n;
+}
+
+
+int
+main(argc, argv)
+  int argc;
+  char *argv[];
+{
+  struct graph *gr;
+  struct solver *s;
+  struct grid *ig,*og;
+  double exact[MAX_RECTS],drawn[MAX_RECTS];
+  double want,got,chi,crit,mean,var,lag,z;
+  double sum,squares,pairs;
+  int v[ROWS*COLS];
+  long grids,steps,k;
+  int i,n,last,bins;
+
+  steps = argc > 1 ? atol(argv[1]) : -1;
+  gr = classic_graph();
+  s = gr != NULL ? new_solver(gr) : NULL;
+  ig = gr != NULL ? new_grid(gr) : NULL;
+  og = gr != NULL ? new_grid(gr) : NULL;
+  if ((s == NULL) || (ig == NULL) || (og == NULL)) {
+    printf("Failed to allocate the puzzle.\n");
+    exit(1);
+  }
+  if (steps < 0) steps = WALK_STEPS(gr);
+
+  for (i=0; i<MAX_RECTS; i++) {
+    exact[i] = drawn[i] = 0;
+  }
+  memset(v, 0, sizeof(v));
+  grids = every_grid(v, 0, exact);
+
+  /* draw the grids as generator_thread() does, into the same grid each time */
+  s->seed = 1;
+  grid_zero(og, gr);
+  sum = squares = pairs = 0;
+  last = 0;
+  for (k=0; k<SAMPLES; k++) {
+    if (!sample_grid(s, ig, og, steps)) {
+      printf("Failed to sample a grid.\n");
+      exit(1);
+    }
+    for (i=0; i<ROWS*COLS; i++) {
+      v[i] = get_value(&og->cells[i]);
+    }
+    n = rectangles(v);
+    drawn[n]++;
+    sum += n;
+    squares += (double) n * n;
+    if (k > 0) pairs += (double) n * last;
+    last = n;
+  }
+
+  /* neighbouring counts go in one bin until it expects at least 5 grids */
+  chi = 0;
+  bins = 0;
+  want = got = 0;
+  for (i=0; i<MAX_RECTS; i++) {
+    want += exact[i] / grids * SAMPLES;
+    got += drawn[i];
+    if ((want >= 5) || ((i == MAX_RECTS-1) && (want > 0))) {
+      chi += (got - want) * (got - want) / want;
+      bins++;
+      want = got = 0;
+    }
+  }
+  /* Wilson and Hilferty's approximation to the chi-squared distribution */
+  crit = (bins - 1) * pow(1 - 2.0/(9*(bins - 1)) + CHI_Z * sqrt(2.0/(9*(bins - 1))), 3);
+
+  mean = sum / SAMPLES;
+  var = squares / SAMPLES - mean * mean;
+  lag = (pairs / (SAMPLES - 1) - mean * mean) / var;
+  z = lag * sqrt((double) SAMPLES);
+
+  printf("%ld grids, %ld drawn with %ld steps\n", grids, SAMPLES, steps);
+  printf("chi-squared %.1f on %d degrees of freedom, %.1f at the 0.1%% level\n", chi, bins - 1, crit);
+  printf("correlation with the grid before %.4f, %.1f standard errors\n", lag, z);
+  exit((chi <= crit) && (fabs(z) <= CHI_Z) ? 0 : 1);
+}